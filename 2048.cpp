@@ -8,6 +8,30 @@
 #include <cassert>
 #include <memory>
 #include <cstring>
+#include <functional>
+#include <array>
+#include <vector>
+#include <cmath>
+#include <tuple>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <iomanip>
+#include <cerrno>
+#include <algorithm>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <signal.h>
 
 #define USE_CURSES 1
 
@@ -16,7 +40,6 @@
 #else
 #include <stdio.h>
 #include <termios.h>
-#include <unistd.h>
 #endif
 
 #define DEBUG 0
@@ -84,12 +107,89 @@ uint_fast64_t boardMasks[4][4] {
     { (uint64_t)0b1111 << 48, (uint64_t)0b1111 << 52, (uint64_t)0b1111 << 56, (uint64_t)0b1111 << 60 }
 };
 
+/* a mask with bit 4*i set iff cell i of the packed board is empty */
+inline uint64_t emptyCellMask(uint64_t board) {
+    board |= board >> 1;
+    board |= board >> 2;
+    return ~board & 0x1111111111111111ULL;
+}
+
+/**
+ * The features of a board that the heuristics are made of, all from
+ * one call of Board::getFeatures().  The entries and their order are
+ * fixed, so that tuning tools can rely on them (see --export-features).
+ * They have the same values, including the same 8-bit wraparound, as
+ * the separate functions that computed them before.
+ */
+struct FeatureVector {
+    enum Index {
+        /* sum of |difference| of exponents of each cell and the next occupied cell right of and below it */
+        SMOOTHNESS,
+        /* how far the rows and columns are from being monotone (see Board::calculateMonotonicity()) */
+        MONOTONICITY,
+        EMPTY_SPACES,
+        LARGEST_EXPONENT,
+        /* as Board::numMatchingPairs() counts them */
+        MATCHING_PAIRS,
+        /* as Board::numEnclosedTwosFours() counts them */
+        ENCLOSED_TWOS_FOURS,
+        SIZE
+    };
+    static const char* const NAMES[SIZE];
+    std::array<uint8_t,SIZE> values;
+    inline uint8_t operator[](Index index) const { return values[index]; }
+    inline uint8_t& operator[](Index index) { return values[index]; }
+    inline bool operator==(const FeatureVector& other) const { return values == other.values; }
+    inline bool operator!=(const FeatureVector& other) const { return values != other.values; }
+};
+const char* const FeatureVector::NAMES[FeatureVector::SIZE] = { "smoothness", "monotonicity", "empty_spaces", "largest_exponent", "matching_pairs", "enclosed_twos_fours" };
+
 class Board {
 private:
     uint64_t rawBoard;
+    /* the features getFeatures() takes from the rows or the columns, four cells step apart from first */
+    struct LineFeatures {
+        uint_fast16_t smoothness;
+        uint_fast8_t increasing;
+        uint_fast8_t decreasing;
+        LineFeatures() : smoothness(0), increasing(0), decreasing(0) {}
+        inline void add(const uint_fast8_t cells[16], size_t first, size_t step) {
+            /* without branches, which random boards mispredict half of the time */
+            int_fast64_t v[4];
+            int_fast64_t o[4];
+            for(size_t j=0; j<4; ++j) {
+                v[j] = cells[first + j * step];
+                o[j] = v[j] != 0;
+            }
+            auto difference = [&v](size_t a, size_t b) { return std::abs(v[a] - v[b]); };
+            /* each occupied cell and the next occupied one */
+            smoothness += o[0] * (o[1] * difference(0, 1) + !o[1] * (o[2] * difference(0, 2) + !o[2] * o[3] * difference(0, 3)))
+                + o[1] * (o[2] * difference(1, 2) + !o[2] * o[3] * difference(1, 3))
+                + o[2] * o[3] * difference(2, 3);
+            /* calculateMonotonicity() compares cell 0, cells 1 and 2 if occupied, and cell 3, in turn */
+            int_fast64_t up = 0;
+            int_fast64_t down = 0;
+            auto compare = [&v, &up, &down](int_fast64_t included, size_t a, size_t b) {
+                int_fast64_t d = (v[b] - v[a]) & -included;
+                int_fast64_t negative = d >> 63;
+                up += d & ~negative;
+                down += -d & negative;
+            };
+            compare(o[1], 0, 1);
+            compare((1 - o[1]) & o[2], 0, 2);
+            compare((1 - o[1]) & (1 - o[2]), 0, 3);
+            compare(o[1] & o[2], 1, 2);
+            compare(o[1] & (1 - o[2]), 1, 3);
+            compare(o[2], 2, 3);
+            increasing += up;
+            decreasing += down;
+        }
+    };
 public:
     Board() : rawBoard(0) {}
     Board(const Board& copy) : rawBoard(copy.rawBoard) {}
+    explicit Board(uint64_t rawBoard) : rawBoard(rawBoard) {}
+    inline uint64_t getRawBoard() const { return rawBoard; }
 private:
     inline uint_fast8_t getExponentValue(uint_fast8_t row, uint_fast8_t col) const {
         return (rawBoard & boardMasks[row][col]) >> boardShifts[row][col];
@@ -183,6 +283,56 @@ public:
     inline uint_fast8_t numEmptySpaces() const {
         return 16 - numFilledSpaces();
     }
+    uint_fast8_t getSmoothness() const {
+        return getFeatures()[FeatureVector::SMOOTHNESS];
+    }
+    /**
+     * All the features in one pass: the cells are unpacked once, and
+     * each row and column is then walked once for all of the features.
+     */
+    FeatureVector getFeatures() const {
+        uint_fast8_t cells[16];
+        uint_fast8_t largest = 0;
+        for(size_t i=0; i<16; ++i) {
+            cells[i] = (rawBoard >> (4 * i)) & 0b1111;
+            largest = std::max(largest, cells[i]);
+        }
+        /* the cell masks are taken on the packed board, one bit per nibble */
+        uint64_t empty = emptyCellMask(rawBoard);
+        uint64_t occupied = empty ^ 0x1111111111111111ULL;
+        uint64_t equalRight = emptyCellMask(rawBoard ^ (rawBoard >> 4)) & occupied & 0x0111011101110111ULL;
+        uint64_t equalDown = emptyCellMask(rawBoard ^ (rawBoard >> 16)) & occupied & 0x0000111111111111ULL;
+        uint64_t matched = equalRight | (equalRight << 4) | equalDown | (equalDown << 16);
+        uint64_t nextToEmpty = ((empty << 4) & 0x1110111011101110ULL) | ((empty >> 4) & 0x0111011101110111ULL) | (empty << 16) | (empty >> 16);
+        uint64_t twosFours = emptyCellMask(rawBoard ^ 0x2222222222222222ULL) | emptyCellMask(rawBoard ^ 0x4444444444444444ULL);
+        LineFeatures rows;
+        LineFeatures columns;
+        for(size_t line=0; line<4; ++line) {
+            rows.add(cells, 4 * line, 1);
+            columns.add(cells, line, 4);
+        }
+        FeatureVector features;
+        features[FeatureVector::SMOOTHNESS] = (uint8_t)(rows.smoothness + columns.smoothness);
+        features[FeatureVector::MONOTONICITY] = (uint8_t)(std::min(rows.increasing, rows.decreasing) + std::min(columns.increasing, columns.decreasing));
+        features[FeatureVector::EMPTY_SPACES] = __builtin_popcountll(empty);
+        features[FeatureVector::LARGEST_EXPONENT] = largest;
+        features[FeatureVector::MATCHING_PAIRS] = __builtin_popcountll(matched) / 2;
+        features[FeatureVector::ENCLOSED_TWOS_FOURS] = __builtin_popcountll(twosFours & nextToEmpty);
+        return features;
+    }
+    /* the features from the separate functions, one pass each, to check getFeatures() against */
+    FeatureVector getFeaturesSeparately() const {
+        uint_fast16_t values[4][4] = { {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0} };
+        fillExponents(values);
+        FeatureVector features;
+        features[FeatureVector::SMOOTHNESS] = calculateSmoothness(values);
+        features[FeatureVector::MONOTONICITY] = calculateMonotonicity(values);
+        features[FeatureVector::EMPTY_SPACES] = numEmptySpaces();
+        features[FeatureVector::LARGEST_EXPONENT] = getLargestExponent();
+        features[FeatureVector::MATCHING_PAIRS] = numMatchingPairs(values);
+        features[FeatureVector::ENCLOSED_TWOS_FOURS] = numEnclosedTwosFours(values);
+        return features;
+    }
     uint_fast8_t getLargestExponent() const {
         uint_fast8_t biggest = 0;
         uint64_t board = rawBoard;
@@ -373,11 +523,752 @@ private:
         }
         return score;
     }
+public:
+    bool has2048() const {
+        uint64_t board = rawBoard;
+        while(board) {
+            if((board & (uint64_t)0b1111) == 11) {
+                return true;
+            }
+            board >>= 4;
+        }
+        return false;
+    }
+    /**
+     * The heuristic value of a position with this board and score.
+     * isGameOver must say whether the player to move has no
+     * successors.
+     */
+    int_fast64_t getHeuristic(uint32_t score, bool isGameOver) const {
+        int_fast64_t h = 0;
+        if(isGameOver) {
+            if(!has2048()) {
+                return 0;
+            }
+            h |= (int_fast64_t)score << 47;
+        }
+        auto features = getFeatures();
+        auto smoothness = 240 - (int_fast64_t)features[FeatureVector::SMOOTHNESS];
+        auto monotonicity = 240 - (int_fast64_t)features[FeatureVector::MONOTONICITY];
+        auto emptySpaces = (int_fast64_t)features[FeatureVector::EMPTY_SPACES];
+        auto largestExponent = (int_fast64_t)features[FeatureVector::LARGEST_EXPONENT];
+        h += 10 * smoothness + 100 * monotonicity + 270 * emptySpaces + 100 * largestExponent;
+        return h;
+    }
+    /**
+     * Heuristic Value:
+     *  MSB | 1 bit       | 16 bits                     | 7 bits                                                                  | ... 
+     *      | always zero | final score, if we got 2048 | number of empty spaces + number of pairs of neighboring matching pieces | ... 
+     *
+     *  ... | 4 bits                                                         | 3 bits                                     | 16 bits       | 17 bits          | LSB
+     *  ... | 16 - number of 2s and 4s that are not bordering an empty space | exponent of the largest piece on the board | current score | currently unused |
+     *
+     * The value is zero if the game is over and we didn't get 2048.
+     */
+    int_fast64_t getHeuristicOld(uint32_t score, bool isGameOver) const {
+        int_fast64_t h = 0;
+        if(isGameOver) {
+            if(!has2048()) {
+                return 0;
+            }
+            h |= (int_fast64_t)score << 47;
+        }
+        auto features = getFeatures();
+        auto emptySpaces = (int_fast64_t)features[FeatureVector::EMPTY_SPACES];
+        auto matchingPairs = (int_fast64_t)features[FeatureVector::MATCHING_PAIRS];
+        h |= (emptySpaces + matchingPairs) << 40;
+        auto enclosedTwosFours = (int_fast64_t)16 - (int_fast64_t)features[FeatureVector::ENCLOSED_TWOS_FOURS];
+        h |= enclosedTwosFours << 36;
+        // auto largestExponent = (int_fast64_t)getLargestExponent();
+        // h |= largestExponent << 33;
+        h |= (int_fast64_t)score << 17;
+        return h;
+    }
 #if DEBUG
     friend std::ostream& operator<<(std::ostream& stream, const Board& board);
 #endif
 };
 
+/**
+ * Lookup tables for sliding a single row of the packed board.  A row
+ * is 16 bits (four exponents, column 0 in the low nibble), so every
+ * possible row fits in a 64k-entry table.  Moving left slides tiles
+ * toward column 0, and columns are moved by transposing the board.
+ */
+struct MoveTables {
+    uint16_t rowLeft[65536];
+    uint16_t rowRight[65536];
+    /* the points scored by a move do not depend on its direction, so
+       the left and right moves share this table */
+    uint32_t rowScore[65536];
+
+    static inline uint16_t reverseRow(uint16_t row) {
+        return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
+    }
+    static void slideRowLeft(uint16_t row, uint16_t& result, uint32_t& score) {
+        uint_fast8_t out[4] = {0, 0, 0, 0};
+        size_t n = 0;
+        bool canMerge = false;
+        score = 0;
+        for(size_t col=0; col<4; ++col) {
+            uint_fast8_t exponent = (row >> (4 * col)) & 0b1111;
+            if(!exponent) {
+                continue;
+            }
+            /* a pair of 32768s would overflow the nibble, so they never merge */
+            if(canMerge && out[n-1] == exponent && exponent < 15) {
+                ++out[n-1];
+                score += 2 << exponent;
+                canMerge = false;
+            } else {
+                out[n++] = exponent;
+                canMerge = true;
+            }
+        }
+        result = out[0] | (out[1] << 4) | (out[2] << 8) | (out[3] << 12);
+    }
+    static MoveTables* build() {
+        MoveTables* tables = new MoveTables();
+        for(uint32_t row=0; row<65536; ++row) {
+            uint16_t left;
+            slideRowLeft((uint16_t)row, left, tables->rowScore[row]);
+            tables->rowLeft[row] = left;
+            uint16_t right;
+            uint32_t ignored;
+            slideRowLeft(reverseRow((uint16_t)row), right, ignored);
+            tables->rowRight[row] = reverseRow(right);
+        }
+        return tables;
+    }
+};
+
+/* set (before any games start) if the tables are mapped from a shared file */
+const MoveTables* mappedMoveTables = nullptr;
+/* set by NumaPlacement::enter() on worker threads that read their NUMA node's copy */
+thread_local const MoveTables* workerMoveTables = nullptr;
+
+const MoveTables& getMoveTables() {
+    if(workerMoveTables) {
+        return *workerMoveTables;
+    } else if(mappedMoveTables) {
+        return *mappedMoveTables;
+    }
+    static std::unique_ptr<MoveTables> tables(MoveTables::build());
+    return *tables;
+}
+
+/* swaps rows and columns of a packed board */
+inline uint64_t transposeBoard(uint64_t board) {
+    uint64_t a1 = board & 0xF0F00F0FF0F00F0FULL;
+    uint64_t a2 = board & 0x0000F0F00000F0F0ULL;
+    uint64_t a3 = board & 0x0F0F00000F0F0000ULL;
+    uint64_t a = a1 | (a2 << 12) | (a3 >> 12);
+    uint64_t b1 = a & 0xFF00FF0000FF00FFULL;
+    uint64_t b2 = a & 0x00FF00FF00000000ULL;
+    uint64_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+/**
+ * Applies a move to a packed board using the row tables.  The board
+ * is unchanged (and score is zero) iff the move is illegal; this
+ * matches Board::move() for every board that does not contain two
+ * neighboring 32768s.
+ */
+inline uint64_t applyMove(const MoveTables& tables, uint64_t board, MoveType move, uint32_t& score) {
+    const uint16_t* rowTable;
+    uint64_t rows = board;
+    switch(move) {
+    case MoveType::UP:
+        rows = transposeBoard(board);
+        /* fall through */
+    case MoveType::LEFT:
+        rowTable = tables.rowLeft;
+        break;
+    case MoveType::DOWN:
+        rows = transposeBoard(board);
+        /* fall through */
+    case MoveType::RIGHT:
+    default:
+        rowTable = tables.rowRight;
+        break;
+    }
+    uint64_t result = 0;
+    score = 0;
+    for(uint_fast8_t shift=0; shift<64; shift+=16) {
+        uint16_t row = (rows >> shift) & 0xFFFF;
+        result |= (uint64_t)rowTable[row] << shift;
+        score += tables.rowScore[row];
+    }
+    if(move == MoveType::UP || move == MoveType::DOWN) {
+        result = transposeBoard(result);
+    }
+    return result;
+}
+
+/* true iff some cell of the packed board holds the given exponent */
+inline bool containsExponent(uint64_t board, uint_fast8_t exponent) {
+    return emptyCellMask(board ^ (0x1111111111111111ULL * exponent)) != 0;
+}
+
+/* the moves in the same order as Node::getSuccessors() generates them */
+const MoveType PLAYER_MOVES[4] = { MoveType::UP, MoveType::DOWN, MoveType::LEFT, MoveType::RIGHT };
+
+/**
+ * The board as four 16-bit planes, plane k holding bit k of every
+ * cell's exponent (cell i = 4 * row + col is bit i).  Tests that look
+ * at every cell, such as which cells are empty, which neighbours are
+ * equal or whether a move is legal, are then a few bitwise operations
+ * on the planes instead of a loop over nibbles.  Comparing exponents
+ * is bit-sliced arithmetic over the planes.  The search itself still
+ * uses the packed board; --bench-board compares the two.
+ */
+class BitplaneBoard {
+private:
+    uint16_t planes[4];
+
+    /* bit 4*i of a packed board to bit i */
+    static inline uint16_t gather(uint64_t bits) {
+        bits &= 0x1111111111111111ULL;
+        bits = (bits | (bits >> 3)) & 0x0303030303030303ULL;
+        bits = (bits | (bits >> 6)) & 0x000F000F000F000FULL;
+        bits = (bits | (bits >> 12)) & 0x000000FF000000FFULL;
+        return (uint16_t)(bits | (bits >> 24));
+    }
+    /* the inverse of gather() */
+    static inline uint64_t scatter(uint16_t plane) {
+        uint64_t bits = plane;
+        bits = (bits | (bits << 24)) & 0x000000FF000000FFULL;
+        bits = (bits | (bits << 12)) & 0x000F000F000F000FULL;
+        bits = (bits | (bits << 6)) & 0x0303030303030303ULL;
+        return (bits | (bits << 3)) & 0x1111111111111111ULL;
+    }
+    /* cells (in mask) whose exponent is equal to that of the cell shift places further on */
+    inline uint16_t equalTo(unsigned shift, uint16_t mask) const {
+        uint16_t occupied = occupiedMask();
+        uint16_t differ = 0;
+        for(auto plane : planes) {
+            differ |= plane ^ (plane >> shift);
+        }
+        return ~differ & occupied & (occupied >> shift) & mask;
+    }
+    /**
+     * The sum of |exponent - next exponent| over the occupied cells that
+     * have an occupied cell further on in the same line, where the cells
+     * are step apart and the lines have 4 cells (see getSmoothness()).
+     */
+    inline uint_fast16_t lineSmoothness(unsigned step, const uint16_t within[3]) const {
+        uint16_t occupied = occupiedMask();
+        /* the next occupied cell is 1, 2 or 3 steps on */
+        uint16_t next1 = (occupied >> step) & within[0];
+        uint16_t next2 = ~(occupied >> step) & (occupied >> (2 * step)) & within[1];
+        uint16_t next3 = ~(occupied >> step) & ~(occupied >> (2 * step)) & (occupied >> (3 * step)) & within[2];
+        uint16_t valid = occupied & (next1 | next2 | next3);
+        uint16_t difference[4];
+        uint16_t borrow = 0;
+        for(size_t k=0; k<4; ++k) {
+            uint16_t a = planes[k];
+            uint16_t b = ((planes[k] >> step) & next1) | ((planes[k] >> (2 * step)) & next2) | ((planes[k] >> (3 * step)) & next3);
+            difference[k] = a ^ b ^ borrow;
+            borrow = (~a & b) | (~(a ^ b) & borrow);
+        }
+        /* negate the cells where the subtraction borrowed */
+        uint16_t carry = borrow;
+        uint_fast16_t total = 0;
+        for(size_t k=0; k<4; ++k) {
+            uint16_t inverted = difference[k] ^ borrow;
+            total += (uint_fast16_t)__builtin_popcount((inverted ^ carry) & valid) << k;
+            carry &= inverted;
+        }
+        return total;
+    }
+public:
+    static const uint16_t COLUMN_0 = 0x1111;
+    static const uint16_t COLUMN_3 = 0x8888;
+    static const uint16_t ROW_0 = 0x000F;
+    static const uint16_t ROW_3 = 0xF000;
+
+    explicit BitplaneBoard(uint64_t board) {
+        for(size_t k=0; k<4; ++k) {
+            planes[k] = gather(board >> k);
+        }
+    }
+    inline uint64_t getRawBoard() const {
+        uint64_t board = 0;
+        for(size_t k=0; k<4; ++k) {
+            board |= scatter(planes[k]) << k;
+        }
+        return board;
+    }
+    inline uint16_t occupiedMask() const {
+        return planes[0] | planes[1] | planes[2] | planes[3];
+    }
+    inline uint16_t emptyMask() const {
+        return ~occupiedMask();
+    }
+    /* cells equal to their right neighbour */
+    inline uint16_t equalRightMask() const {
+        return equalTo(1, (uint16_t)~COLUMN_3);
+    }
+    /* cells equal to the neighbour below them */
+    inline uint16_t equalDownMask() const {
+        return equalTo(4, (uint16_t)~ROW_3);
+    }
+    inline uint16_t exponentMask(uint_fast8_t exponent) const {
+        uint16_t mask = 0xFFFF;
+        for(size_t k=0; k<4; ++k) {
+            mask &= (exponent >> k) & 1 ? planes[k] : (uint16_t)~planes[k];
+        }
+        return mask;
+    }
+    inline uint_fast8_t numEmptySpaces() const {
+        return __builtin_popcount(emptyMask());
+    }
+    uint_fast8_t getLargestExponent() const {
+        uint16_t candidates = occupiedMask();
+        uint_fast8_t exponent = 0;
+        for(size_t k=4; k-- > 0;) {
+            if(candidates & planes[k]) {
+                candidates &= planes[k];
+                exponent |= 1 << k;
+            }
+        }
+        return exponent;
+    }
+    /* bit m is set iff PLAYER_MOVES[m] changes the board */
+    inline uint_fast8_t legalMoves() const {
+        uint16_t occupied = occupiedMask();
+        uint16_t empty = ~occupied;
+        bool vertical = equalDownMask() != 0;
+        bool horizontal = equalRightMask() != 0;
+        uint_fast8_t legal = 0;
+        legal |= (vertical || (occupied & (empty << 4) & ~ROW_0)) << 0;
+        legal |= (vertical || (occupied & (empty >> 4) & ~ROW_3)) << 1;
+        legal |= (horizontal || (occupied & (empty << 1) & ~COLUMN_0)) << 2;
+        legal |= (horizontal || (occupied & (empty >> 1) & ~COLUMN_3)) << 3;
+        return legal;
+    }
+    inline bool isGameOver() const {
+        return !emptyMask() && !equalRightMask() && !equalDownMask();
+    }
+    /* as Board::numMatchingPairs() */
+    inline uint_fast8_t numMatchingPairs() const {
+        uint16_t right = equalRightMask();
+        uint16_t down = equalDownMask();
+        return __builtin_popcount((uint16_t)(right | (right << 1) | down | (down << 4))) / 2;
+    }
+    /* as Board::numEnclosedTwosFours() */
+    inline uint_fast8_t numEnclosedTwosFours() const {
+        uint16_t empty = emptyMask();
+        uint16_t nextToEmpty = ((empty << 1) & ~COLUMN_0) | ((empty >> 1) & ~COLUMN_3) | (empty << 4) | (empty >> 4);
+        return __builtin_popcount((uint16_t)((exponentMask(2) | exponentMask(4)) & nextToEmpty));
+    }
+    /* as Board::getSmoothness() */
+    inline uint_fast8_t getSmoothness() const {
+        static const uint16_t withinRow[3] = { 0x7777, 0x3333, 0x1111 };
+        static const uint16_t withinColumn[3] = { 0x0FFF, 0x00FF, 0x000F };
+        return lineSmoothness(1, withinRow) + lineSmoothness(4, withinColumn);
+    }
+    /* as Board::getHeuristicOld() */
+    int_fast64_t getHeuristicOld(uint32_t score, bool isGameOver) const {
+        int_fast64_t h = 0;
+        if(isGameOver) {
+            if(!exponentMask(11)) {
+                return 0;
+            }
+            h |= (int_fast64_t)score << 47;
+        }
+        h |= ((int_fast64_t)numEmptySpaces() + (int_fast64_t)numMatchingPairs()) << 40;
+        h |= ((int_fast64_t)16 - (int_fast64_t)numEnclosedTwosFours()) << 36;
+        h |= (int_fast64_t)score << 17;
+        return h;
+    }
+};
+
+/**
+ * Heuristic value of a single row (or column) of four exponents,
+ * used to fill in the default row weights: rewards empty cells and
+ * possible merges, and penalizes non-monotone rows and large tiles
+ * that are away from the edge.
+ */
+float defaultRowWeight(uint16_t row) {
+    int exponents[4];
+    for(size_t col=0; col<4; ++col) {
+        exponents[col] = (row >> (4 * col)) & 0b1111;
+    }
+    float sum = 0.0f;
+    int empty = 0;
+    int merges = 0;
+    int previous = 0;
+    int counter = 0;
+    for(size_t col=0; col<4; ++col) {
+        int exponent = exponents[col];
+        sum += std::pow((float)exponent, 3.5f);
+        if(!exponent) {
+            ++empty;
+        } else if(previous == exponent) {
+            ++counter;
+        } else if(counter > 0) {
+            merges += 1 + counter;
+            counter = 0;
+        }
+        if(exponent) {
+            previous = exponent;
+        }
+    }
+    if(counter > 0) {
+        merges += 1 + counter;
+    }
+    float monotoneLeft = 0.0f;
+    float monotoneRight = 0.0f;
+    for(size_t col=1; col<4; ++col) {
+        float a = std::pow((float)exponents[col-1], 4.0f);
+        float b = std::pow((float)exponents[col], 4.0f);
+        if(exponents[col-1] > exponents[col]) {
+            monotoneLeft += a - b;
+        } else {
+            monotoneRight += b - a;
+        }
+    }
+    return 200000.0f + 270.0f * empty + 700.0f * merges - 47.0f * std::min(monotoneLeft, monotoneRight) - 11.0f * sum;
+}
+
+const size_t NUM_ROW_WEIGHTS = 65536;
+const char ROW_WEIGHTS_MAGIC[8] = { '2', '0', '4', '8', 'R', 'W', 'T', '1' };
+
+std::vector<float> defaultRowWeights() {
+    std::vector<float> weights(NUM_ROW_WEIGHTS);
+    for(size_t row=0; row<NUM_ROW_WEIGHTS; ++row) {
+        weights[row] = defaultRowWeight((uint16_t)row);
+    }
+    return weights;
+}
+
+/**
+ * A full-precision row weight file is the 8-byte ROW_WEIGHTS_MAGIC
+ * followed by NUM_ROW_WEIGHTS native-endian floats, indexed by the
+ * packed row.
+ */
+bool saveRowWeights(const char* path, const std::vector<float>& weights) {
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        std::cerr << "Error opening " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool ok = fwrite(ROW_WEIGHTS_MAGIC, 1, sizeof(ROW_WEIGHTS_MAGIC), file) == sizeof(ROW_WEIGHTS_MAGIC)
+        && fwrite(weights.data(), sizeof(float), weights.size(), file) == weights.size();
+    ok = fclose(file) == 0 && ok;
+    if(!ok) {
+        std::cerr << "Error writing " << path << std::endl;
+    }
+    return ok;
+}
+
+bool loadRowWeights(const char* path, std::vector<float>& weights) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        std::cerr << "Error opening " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    char magic[sizeof(ROW_WEIGHTS_MAGIC)];
+    weights.resize(NUM_ROW_WEIGHTS);
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && !memcmp(magic, ROW_WEIGHTS_MAGIC, sizeof(magic))
+        && fread(weights.data(), sizeof(float), weights.size(), file) == weights.size();
+    fclose(file);
+    if(!ok) {
+        std::cerr << path << " is not a row weight file" << std::endl;
+    }
+    return ok;
+}
+
+/**
+ * Evaluates a packed board as the sum of the weights of its four rows
+ * and four columns.  With an integer Weight type the full-precision
+ * weights are affinely quantized (w ~= q * scale + offset), which
+ * shrinks the table from 256KiB of floats to 128KiB (int16_t) or
+ * 64KiB (int8_t) so that it stays resident in L2.
+ */
+template<class Weight>
+class RowWeightTable {
+private:
+    /* either points into storage or at weights owned by someone else (e.g., a shared mapping) */
+    const Weight* weights;
+    std::vector<Weight> storage;
+    float scale;
+    float offset;
+public:
+    RowWeightTable(const std::vector<float>& fullPrecision) : storage(fullPrecision.size()), scale(1.0f), offset(0.0f) {
+        weights = storage.data();
+        if(std::is_floating_point<Weight>::value) {
+            std::copy(fullPrecision.begin(), fullPrecision.end(), storage.begin());
+            return;
+        }
+        auto range = std::minmax_element(fullPrecision.begin(), fullPrecision.end());
+        float qmin = (float)std::numeric_limits<Weight>::min();
+        float qmax = (float)std::numeric_limits<Weight>::max();
+        if(*range.second > *range.first) {
+            scale = (*range.second - *range.first) / (qmax - qmin);
+        }
+        offset = *range.first - qmin * scale;
+        for(size_t i=0; i<fullPrecision.size(); ++i) {
+            storage[i] = (Weight)std::max(qmin, std::min(qmax, std::round((fullPrecision[i] - offset) / scale)));
+        }
+    }
+    /* wraps NUM_ROW_WEIGHTS existing weights without copying them */
+    RowWeightTable(const Weight* weights, float scale, float offset) : weights(weights), scale(scale), offset(offset) {}
+    RowWeightTable(const RowWeightTable& copy) : weights(copy.weights), storage(copy.storage), scale(copy.scale), offset(copy.offset) {
+        if(!storage.empty()) {
+            weights = storage.data();
+        }
+    }
+    RowWeightTable& operator=(const RowWeightTable&) = delete;
+    const Weight* getWeights() const { return weights; }
+    float getScale() const { return scale; }
+    float getOffset() const { return offset; }
+    size_t footprint() const { return NUM_ROW_WEIGHTS * sizeof(Weight); }
+    inline int_fast64_t evaluate(uint64_t board) const {
+        typedef typename std::conditional<std::is_floating_point<Weight>::value, float, int32_t>::type Sum;
+        uint64_t columns = transposeBoard(board);
+        Sum sum = 0;
+        for(uint_fast8_t shift=0; shift<64; shift+=16) {
+            sum += weights[(board >> shift) & 0xFFFF];
+            sum += weights[(columns >> shift) & 0xFFFF];
+        }
+        return (int_fast64_t)std::llround(sum * scale + 8 * offset);
+    }
+};
+
+/**
+ * Layout of a shared tables file.  Every table starts on its own page
+ * so that it can be used in place once the file is mapped.
+ */
+struct SharedTablesHeader {
+    char     magic[8];
+    uint64_t fileSize;
+    uint64_t moveTablesOffset;
+    uint64_t floatWeightsOffset;
+    uint64_t int16WeightsOffset;
+    uint64_t int8WeightsOffset;
+    float    int16Scale;
+    float    int16Offset;
+    float    int8Scale;
+    float    int8Offset;
+};
+
+const char SHARED_TABLES_MAGIC[8] = { '2', '0', '4', '8', 'S', 'H', 'T', '1' };
+
+/**
+ * The move tables and every precision of the row weights, generated
+ * once into a file and then mapped read-only by each process.  All
+ * processes on a host share the same physical pages, and startup is
+ * just an mmap() instead of rebuilding the tables.
+ */
+class SharedTables {
+private:
+    const char* mapping;
+    size_t length;
+    const SharedTablesHeader* header;
+    static uint64_t pageAlign(uint64_t offset) {
+        return (offset + 4095) & ~(uint64_t)4095;
+    }
+public:
+    SharedTables() : mapping(nullptr), length(0), header(nullptr) {}
+    SharedTables(const SharedTables&) = delete;
+    ~SharedTables() {
+        if(mapping) {
+            munmap((void*)mapping, length);
+        }
+    }
+    /**
+     * Generates the tables into path.  The file is written under a
+     * temporary name and renamed into place, so concurrent processes
+     * never map a partially written file.
+     */
+    static bool write(const char* path, const std::vector<float>& rowWeights) {
+        std::unique_ptr<MoveTables> moveTables(MoveTables::build());
+        RowWeightTable<int16_t> int16Table(rowWeights);
+        RowWeightTable<int8_t> int8Table(rowWeights);
+        SharedTablesHeader h = {};
+        memcpy(h.magic, SHARED_TABLES_MAGIC, sizeof(h.magic));
+        h.moveTablesOffset = pageAlign(sizeof(SharedTablesHeader));
+        h.floatWeightsOffset = pageAlign(h.moveTablesOffset + sizeof(MoveTables));
+        h.int16WeightsOffset = pageAlign(h.floatWeightsOffset + NUM_ROW_WEIGHTS * sizeof(float));
+        h.int8WeightsOffset = pageAlign(h.int16WeightsOffset + NUM_ROW_WEIGHTS * sizeof(int16_t));
+        h.fileSize = pageAlign(h.int8WeightsOffset + NUM_ROW_WEIGHTS * sizeof(int8_t));
+        h.int16Scale = int16Table.getScale();
+        h.int16Offset = int16Table.getOffset();
+        h.int8Scale = int8Table.getScale();
+        h.int8Offset = int8Table.getOffset();
+
+        std::vector<char> contents(h.fileSize, 0);
+        memcpy(&contents[0], &h, sizeof(h));
+        memcpy(&contents[h.moveTablesOffset], moveTables.get(), sizeof(MoveTables));
+        memcpy(&contents[h.floatWeightsOffset], rowWeights.data(), NUM_ROW_WEIGHTS * sizeof(float));
+        memcpy(&contents[h.int16WeightsOffset], int16Table.getWeights(), NUM_ROW_WEIGHTS * sizeof(int16_t));
+        memcpy(&contents[h.int8WeightsOffset], int8Table.getWeights(), NUM_ROW_WEIGHTS * sizeof(int8_t));
+
+        std::stringstream tempPath;
+        tempPath << path << ".tmp." << getpid();
+        FILE* file = fopen(tempPath.str().c_str(), "wb");
+        if(!file) {
+            std::cerr << "Error opening " << tempPath.str() << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        ok = fclose(file) == 0 && ok;
+        if(!ok || rename(tempPath.str().c_str(), path)) {
+            std::cerr << "Error writing " << path << ": " << strerror(errno) << std::endl;
+            unlink(tempPath.str().c_str());
+            return false;
+        }
+        return true;
+    }
+    bool map(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) {
+            std::cerr << "Error opening " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) || (size_t)st.st_size < sizeof(SharedTablesHeader)) {
+            std::cerr << path << " is not a shared tables file" << std::endl;
+            close(fd);
+            return false;
+        }
+        void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(m == MAP_FAILED) {
+            std::cerr << "Error mapping " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        mapping = (const char*)m;
+        length = st.st_size;
+        header = (const SharedTablesHeader*)mapping;
+        if(memcmp(header->magic, SHARED_TABLES_MAGIC, sizeof(header->magic)) || header->fileSize != length) {
+            std::cerr << path << " is not a shared tables file" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    /* maps path, generating it from rowWeights first if it does not exist yet */
+    bool open(const char* path, const std::function<std::vector<float>()>& rowWeights) {
+        if(access(path, F_OK) && !write(path, rowWeights())) {
+            return false;
+        }
+        return map(path);
+    }
+    /* whether the row weights were generated from rowWeights; the quantized ones follow from the floats */
+    bool hasRowWeights(const std::vector<float>& rowWeights) const {
+        return rowWeights.size() == NUM_ROW_WEIGHTS && !memcmp(mapping + header->floatWeightsOffset, rowWeights.data(), NUM_ROW_WEIGHTS * sizeof(float));
+    }
+    const MoveTables& getMoveTables() const {
+        return *(const MoveTables*)(mapping + header->moveTablesOffset);
+    }
+    RowWeightTable<float> getFloatWeights() const {
+        return RowWeightTable<float>((const float*)(mapping + header->floatWeightsOffset), 1.0f, 0.0f);
+    }
+    RowWeightTable<int16_t> getInt16Weights() const {
+        return RowWeightTable<int16_t>((const int16_t*)(mapping + header->int16WeightsOffset), header->int16Scale, header->int16Offset);
+    }
+    RowWeightTable<int8_t> getInt8Weights() const {
+        return RowWeightTable<int8_t>((const int8_t*)(mapping + header->int8WeightsOffset), header->int8Scale, header->int8Offset);
+    }
+};
+
+inline uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * xoshiro256** (Blackman and Vigna): a fast generator with a period of
+ * 2^256 - 1 and no shared state.  jump() skips ahead 2^128 draws, so
+ * the streams of one seed (see stream()) never overlap.  Usable as a
+ * UniformRandomBitGenerator with the standard distributions, but
+ * below() is faster and has no bias.
+ */
+class Xoshiro256 {
+private:
+    uint64_t s[4];
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+public:
+    typedef uint64_t result_type;
+    /* the state is expanded from the seed with SplitMix64, so similar seeds give unrelated streams */
+    explicit Xoshiro256(uint64_t seed = 0) {
+        for(auto& word : s) {
+            word = splitMix64(seed);
+        }
+    }
+    /* the k-th of the non-overlapping streams of seed */
+    static Xoshiro256 stream(uint64_t seed, uint64_t k) {
+        Xoshiro256 rand(seed);
+        for(; k; --k) {
+            rand.jump();
+        }
+        return rand;
+    }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    inline result_type operator()() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    /* equivalent to 2^128 draws */
+    void jump() {
+        static const uint64_t JUMP[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for(uint64_t word : JUMP) {
+            for(int b=0; b<64; ++b) {
+                if(word & (1ULL << b)) {
+                    for(size_t i=0; i<4; ++i) {
+                        t[i] ^= s[i];
+                    }
+                }
+                (*this)();
+            }
+        }
+        std::copy(t, t + 4, s);
+    }
+    /* uniform in [0, bound), by Lemire's multiply-and-reject method; bound must be positive */
+    inline uint32_t below(uint32_t bound) {
+        uint64_t m = ((*this)() >> 32) * bound;
+        if(unlikely((uint32_t)m < bound)) {
+            uint32_t threshold = -bound % bound;
+            while((uint32_t)m < threshold) {
+                m = ((*this)() >> 32) * bound;
+            }
+        }
+        return (uint32_t)(m >> 32);
+    }
+};
+
+/* the seed that the streams of threadRandom() are split off from */
+uint64_t threadRandomSeed = 0;
+
+/**
+ * A stream for the calling thread, for the code that used ::rand().
+ * Threads get the streams of threadRandomSeed in the order they first
+ * call this, so only single-threaded use is reproducible; parallel
+ * code gives each game or worker a stream of its own instead.
+ */
+Xoshiro256& threadRandom() {
+    static std::atomic<uint64_t> nextStream(0);
+    thread_local Xoshiro256 rand(Xoshiro256::stream(threadRandomSeed, nextStream++));
+    return rand;
+}
+
 enum class Player : bool {
     HUMAN,
     RANDOM
@@ -468,64 +1359,14 @@ public:
     Player getPlayer() const { return player; }
     bool has2048() const {
         /* see if we got 2048! */
-        for(uint_fast8_t row=0; row<4; ++row) {
-            for(uint_fast8_t col=0; col<4; ++col) {
-                if(board.getValue(row, col) == 2048) {
-                    return true;
-                }
-            }
-        }
-        return false;
+        return board.has2048();
     }
     uint16_t getScore() const { return score; }
     int_fast64_t getHeuristic() const {
-        int_fast64_t h = 0;
-        auto& board = getBoard();
-        if(isGameOver()) {
-            if(!has2048()) {
-                return 0;
-            }
-            h |= (int_fast64_t)(getScore()) << 47;
-        }
-        uint_fast16_t values[4][4] = { {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0} };
-        board.fillExponents(values);
-        auto smoothness = 240 - (int_fast64_t)board.calculateSmoothness(values);
-        auto monotonicity = 240 - (int_fast64_t)board.calculateMonotonicity(values);
-        auto emptySpaces = (int_fast64_t)board.numEmptySpaces();
-        auto largestExponent = (int_fast64_t)board.getLargestExponent();
-        h += 10 * smoothness + 100 * monotonicity + 270 * emptySpaces + 100 * largestExponent;
-        return h;
+        return board.getHeuristic(score, isGameOver());
     }
-    /**
-     * Heuristic Value:
-     *  MSB | 1 bit       | 16 bits                     | 7 bits                                                                  | ... 
-     *      | always zero | final score, if we got 2048 | number of empty spaces + number of pairs of neighboring matching pieces | ... 
-     *
-     *  ... | 4 bits                                                         | 3 bits                                     | 16 bits       | 17 bits          | LSB
-     *  ... | 16 - number of 2s and 4s that are not bordering an empty space | exponent of the largest piece on the board | current score | currently unused |
-     *
-     * The value is zero if the game is over and we didn't get 2048.
-     */
     int_fast64_t getHeuristicOld() const {
-        int_fast64_t h = 0;
-        auto& board = getBoard();
-        if(isGameOver()) {
-            if(!has2048()) {
-                return 0;
-            }
-            h |= (int_fast64_t)(getScore()) << 47;
-        }
-        uint_fast16_t values[4][4] = { {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0} };
-        board.fillExponents(values);
-        auto emptySpaces = (int_fast64_t)board.numEmptySpaces();
-        auto matchingPairs = (int_fast64_t)board.numMatchingPairs(values);
-        h |= (emptySpaces + matchingPairs) << 40;
-        auto enclosedTwosFours = (int_fast64_t)16 - (int_fast64_t)board.numEnclosedTwosFours(values);
-        h |= enclosedTwosFours << 36;
-        // auto largestExponent = (int_fast64_t)board.getLargestExponent();
-        // h |= largestExponent << 33;
-        h |= (int_fast64_t)(getScore()) << 17;
-        return h;
+        return board.getHeuristicOld(score, isGameOver());
     }
 public:
     struct NodeAllocator: std::allocator<Node> {
@@ -550,16 +1391,11 @@ public:
                    assumptions about the ordering of these successors;
                    if you change the ordering, you will need to change
                    that function! */
-                for(uint_fast8_t row=0; row<4; ++row) {
-                    for(uint_fast8_t col=0; col<4; ++col) {
-                        if(!board.getValue(row, col)) {
-                            for(auto value : {1, 2}) {
-                                auto newNode = cachedSuccessors->emplace(cachedSuccessors->end(), *this);
-                                newNode->board.setValue(row, col, value);
-                                newNode->player = Player::HUMAN;
-                                newNode->move = MoveType::RAND;
-                            }
-                        }
+                /* the empty cells come out of the mask in row-major order */
+                uint64_t raw = board.getRawBoard();
+                for(uint64_t empty = emptyCellMask(raw); empty; empty &= empty - 1) {
+                    for(uint64_t tile : {1, 2}) {
+                        cachedSuccessors->emplace_back(Move::RAND, Board(raw | (tile << __builtin_ctzll(empty))), Player::HUMAN, score);
                     }
                 }
             } else {
@@ -594,32 +1430,24 @@ public:
      * a 4.
      */
     Node getRandomSuccessorForComputer() const {
+        return getRandomSuccessorForComputer(threadRandom());
+    }
+    /* Same as getRandomSuccessorForComputer(), but draws from the
+     * given stream so that a game is reproducible from its seed.
+     */
+    Node getRandomSuccessorForComputer(Xoshiro256& rand) const {
         /* this assumes that the successors are interleaved as a new 2
            square then a new 4 square... */
         const std::list<Node>& successors = getSuccessors();
-        bool isTwo = (int_fast64_t)::rand() * 10 < (int_fast64_t)RAND_MAX * 9;
-        auto i = (::rand() % (successors.size() / 2)) * 2;
-        size_t j = 0;
-        bool returnNext = false;
-        for(auto& node : successors) {
-            if(unlikely(returnNext)) {
-                return node;
-            } else if(j++ == i) {
-                if(likely(isTwo)) {
-                    return node;
-                } else {
-                    returnNext = true;
-                }
-            }
-        }
-        return Node();
+        bool isTwo = rand.below(10) < 9;
+        auto i = rand.below((uint32_t)(successors.size() / 2)) * 2 + (isTwo ? 0 : 1);
+        auto iter = successors.begin();
+        std::advance(iter, i);
+        return *iter;
     }
     Node getRandomSuccessor() const {
         const std::list<Node>& successors = getSuccessors();
-        //std::uniform_int_distribution<size_t> sDist(0,successors.size()-1);
-        //auto index = std::bind(sDist, *rand);
-        //auto i = index();
-        auto i = ::rand() % successors.size();
+        auto i = threadRandom().below((uint32_t)successors.size());
         size_t j = 0;
         for(auto& node : successors) {
             if(j++ == i) {
@@ -717,164 +1545,3831 @@ struct AlphaBetaResult {
     int_fast64_t         value;
     MoveType             move;
     TerminationCondition terminationCondition;
+    /* in multi-PV mode, bit m is set iff moveValues[m] is the exact value of PLAYER_MOVES[m] */
+    uint8_t              valuedMoves;
     size_t               prunedNodes;
+    /* max and chance nodes visited, including this one */
+    size_t               searchedNodes;
+    int_fast64_t         moveValues[4];
+
+    AlphaBetaResult() : value(0), move(MoveType::GAMEOVER), terminationCondition(TerminationCondition::ABORT), valuedMoves(0), prunedNodes(0), searchedNodes(0) {}
+    AlphaBetaResult(int_fast64_t value, MoveType move, TerminationCondition terminationCondition, size_t prunedNodes, size_t searchedNodes = 1) : value(value), move(move), terminationCondition(terminationCondition), valuedMoves(0), prunedNodes(prunedNodes), searchedNodes(searchedNodes) {}
+};
+
+/* prints the multi-PV values of a result as, e.g., "^ 1234  V 1200  < -  > 987" */
+std::ostream& printMoveValues(std::ostream& stream, const AlphaBetaResult& result) {
+    const char symbols[4] = { '^', 'V', '<', '>' };
+    for(size_t m=0; m<4; ++m) {
+        if(m) {
+            stream << "  ";
+        }
+        stream << symbols[m] << " ";
+        if(result.valuedMoves & (1 << m)) {
+            stream << (long long)result.moveValues[m];
+        } else {
+            stream << "-";
+        }
+    }
+    return stream;
+}
+
+/**
+ * Sparse sampling of chance nodes: at depth >= depth, a chance node
+ * with more than numSamples empty cells only searches the spawns (a 2
+ * and a 4) in numSamples of them, drawn uniformly without replacement.
+ * Every cell is equally likely to be drawn, and the 0.9/0.1 weights
+ * are applied once, when the spawns of a cell are averaged, so the
+ * expectimax value is an unbiased estimate of the full average.  The
+ * draw depends only on the seed, the board and the depth, so a search
+ * is reproducible for a given seed no matter what order (or how many
+ * times) nodes are visited in.
+ */
+struct ChanceSampling {
+    size_t   depth;
+    size_t   numSamples;
+    uint64_t seed;
+    ChanceSampling() : depth(std::numeric_limits<size_t>::max()), numSamples(2), seed(0) {}
+    ChanceSampling(size_t depth, size_t numSamples, uint64_t seed) : depth(depth), numSamples(numSamples), seed(seed) {}
+    inline bool applies(size_t nodeDepth, size_t numSpawns) const {
+        return nodeDepth >= depth && numSpawns > 2 * numSamples;
+    }
+};
+
+const ChanceSampling NO_CHANCE_SAMPLING;
+
+/**
+ * Returns a bitmask over the chance node's successors (in
+ * getSuccessors() order, i.e., alternating 2s and 4s) of the ones to
+ * search.
+ */
+uint32_t sampleSpawns(uint64_t board, size_t depth, size_t numSpawns, const ChanceSampling& sampling) {
+    uint64_t state = sampling.seed ^ board ^ ((uint64_t)depth << 58);
+    uint32_t selected = 0;
+    /* a partial Fisher-Yates shuffle of the cells */
+    size_t numCells = numSpawns / 2;
+    uint8_t cells[16];
+    for(size_t i=0; i<numCells; ++i) {
+        cells[i] = (uint8_t)i;
+    }
+    for(size_t s=0; s<std::min(sampling.numSamples, numCells); ++s) {
+        size_t j = s + (size_t)(((splitMix64(state) >> 32) * (numCells - s)) >> 32);
+        std::swap(cells[s], cells[j]);
+        selected |= 3u << (2 * cells[s]);
+    }
+    return selected;
+}
+
+/**
+ * The search is a template over four policies, so that every plug-in
+ * point inlines into the recursion:
+ *
+ *  Evaluator(board, score, isGameOver) -> int_fast64_t
+ *      the value of a leaf;
+ *  Terminator(board, depth, player) -> TerminationCondition
+ *      whether to keep searching, evaluate, or abort (a max node and
+ *      the chance nodes below it have the same depth);
+ *  SpawnSelector.select(afterstate, depth, numSpawns) -> uint32_t
+ *      bitmask of the spawns (in getSuccessors() order) a chance node
+ *      searches;
+ *  ChanceModel
+ *      whether the spawner is an adversary (minimax) or random
+ *      (expectimax).
+ *
+ * The useful combinations are instantiated by searchWith(), which
+ * dispatches on the runtime SearchOptions once at the root.
+ */
+struct HeuristicEvaluator {
+    inline int_fast64_t operator()(uint64_t board, uint32_t score, bool isGameOver) const {
+        return Board(board).getHeuristic(score, isGameOver);
+    }
+};
+
+struct OldHeuristicEvaluator {
+    inline int_fast64_t operator()(uint64_t board, uint32_t score, bool isGameOver) const {
+        return Board(board).getHeuristicOld(score, isGameOver);
+    }
+};
+
+/* like getHeuristic(), losing is worse and reaching 2048 better than any table value */
+template<class Weight>
+struct RowTableEvaluator {
+    const RowWeightTable<Weight>* table;
+    RowTableEvaluator(const RowWeightTable<Weight>* table) : table(table) {}
+    inline int_fast64_t operator()(uint64_t board, uint32_t score, bool isGameOver) const {
+        if(unlikely(isGameOver)) {
+            if(!containsExponent(board, 11)) {
+                return -((int_fast64_t)1 << 46);
+            }
+            return ((int_fast64_t)score << 47) + table->evaluate(board);
+        }
+        return table->evaluate(board);
+    }
+};
+
+struct LeafCacheCounts {
+    uint64_t probes;
+    uint64_t hits;
+};
+
+/* of all the calling thread's leaf caches since the last takeLeafCacheCounts() */
+thread_local LeafCacheCounts leafCacheCounts = { 0, 0 };
+
+LeafCacheCounts takeLeafCacheCounts() {
+    LeafCacheCounts counts = leafCacheCounts;
+    leafCacheCounts = { 0, 0 };
+    return counts;
+}
+
+void addLeafCacheCounts(const LeafCacheCounts& counts) {
+    leafCacheCounts.probes += counts.probes;
+    leafCacheCounts.hits += counts.hits;
+}
+
+/**
+ * A direct-mapped cache of leaf values, keyed by the raw board.  The
+ * same position is reached by many move orders, and more so again by
+ * every iteration of iterative deepening, so a small cache saves a
+ * good share of the evaluations.
+ *
+ * Each thread has its own cache per evaluator type (forThread()), so
+ * nothing is shared or locked; 2^14 entries of 16 bytes fit in a
+ * typical 256 KiB L2.  A cache remembers the evaluator instance that
+ * filled it (the weight table, say) and starts over when another one
+ * probes it.
+ */
+class LeafCache {
+public:
+    static const unsigned BITS = 14;
+private:
+    struct Entry {
+        uint64_t board;
+        int_fast64_t value;
+    };
+    std::vector<Entry> entries;
+    const void* owner;
+    void clear() {
+        /* no board has every cell at 2^15 */
+        std::fill(entries.begin(), entries.end(), Entry{ ~(uint64_t)0, 0 });
+    }
+public:
+    LeafCache() : entries((size_t)1 << BITS), owner(nullptr) {
+        clear();
+    }
+    template<class Evaluator>
+    static LeafCache& forThread() {
+        static thread_local LeafCache cache;
+        return cache;
+    }
+    template<class Evaluate>
+    inline int_fast64_t lookup(uint64_t board, const void* evaluator, const Evaluate& evaluate) {
+        if(unlikely(owner != evaluator)) {
+            clear();
+            owner = evaluator;
+        }
+        Entry& entry = entries[(board * 0x9E3779B97F4A7C15ULL) >> (64 - BITS)];
+        ++leafCacheCounts.probes;
+        if(entry.board == board) {
+            ++leafCacheCounts.hits;
+            return entry.value;
+        }
+        entry.board = board;
+        entry.value = evaluate();
+        return entry.value;
+    }
+};
+
+/* the instance whose values a LeafCache holds; the heuristics have no state */
+template<class Evaluator>
+inline const void* evaluatorIdentity(const Evaluator&) { return nullptr; }
+template<class Weight>
+inline const void* evaluatorIdentity(const RowTableEvaluator<Weight>& evaluate) { return evaluate.table; }
+
+/* whether the value of a leaf that is not game over depends only on the board */
+template<class Evaluator>
+inline bool leafValueIgnoresScore(const Evaluator&) { return true; }
+inline bool leafValueIgnoresScore(const OldHeuristicEvaluator&) { return false; }
+
+/**
+ * Looks leaves up in the calling thread's LeafCache before evaluating
+ * them.  The cache is keyed by the board alone, so game-over leaves
+ * (whose value includes the score) and every leaf of an evaluator that
+ * adds the score, like getHeuristicOld(), are evaluated directly.
+ */
+template<class Evaluator>
+struct CachedEvaluator {
+    Evaluator evaluate;
+    CachedEvaluator(const Evaluator& evaluate) : evaluate(evaluate) {}
+    inline int_fast64_t operator()(uint64_t board, uint32_t score, bool isGameOver) const {
+        if(unlikely(isGameOver) || !leafValueIgnoresScore(evaluate)) {
+            return evaluate(board, score, isGameOver);
+        }
+        return LeafCache::forThread<Evaluator>().lookup(board, evaluatorIdentity(evaluate), [&]() { return evaluate(board, score, false); });
+    }
+};
+
+/**
+ * Whether the heuristics are likely to misjudge a leaf because it is
+ * about to change a lot: the board is nearly full, the largest tile
+ * (from 128 up) has left its corner, or two tiles of 64 or more can
+ * merge.
+ */
+inline bool isUnstable(uint64_t board) {
+    if(__builtin_popcountll(emptyCellMask(board)) <= 2) {
+        return true;
+    }
+    uint_fast8_t largest = 0;
+    for(size_t i=0; i<16; ++i) {
+        uint_fast8_t exponent = (board >> (4 * i)) & 0xf;
+        largest = std::max(largest, exponent);
+        if(exponent >= 6) {
+            if((i & 3) != 3 && ((board >> (4 * i + 4)) & 0xf) == exponent) {
+                return true;
+            }
+            if(i < 12 && ((board >> (4 * i + 16)) & 0xf) == exponent) {
+                return true;
+            }
+        }
+    }
+    if(largest < 7) {
+        return false;
+    }
+    for(unsigned shift : {0, 12, 48, 60}) {
+        if(((board >> shift) & 0xf) == largest) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Quiescence-style extension: a leaf at or past the nominal depth is
+ * searched on instead of evaluated if it isUnstable(), fewer than
+ * budget nodes of this search have been extended so far, and the
+ * extension stays within plies extra moves.  With one ply, an unstable
+ * leaf is valued by its best move's afterstate, which is usually
+ * enough to see a merge chain through; each further ply adds the
+ * spawns and another move.
+ */
+struct LeafExtension {
+    size_t plies;
+    size_t budget;
+    LeafExtension() : plies(0), budget(20000) {}
+    LeafExtension(size_t plies, size_t budget) : plies(plies), budget(budget) {}
+};
+
+/* the extension budget of one search, shared by all of its threads */
+class ExtensionBudget {
+private:
+    LeafExtension extension;
+    std::atomic<size_t> used;
+public:
+    ExtensionBudget(const LeafExtension& extension) : extension(extension), used(0) {}
+    inline bool extends(uint64_t board, size_t pliesPastDepth, Player player) {
+        return pliesPastDepth + (player == Player::RANDOM) < extension.plies && isUnstable(board) && used.fetch_add(1, std::memory_order_relaxed) < extension.budget;
+    }
+};
+
+struct DepthTerminator {
+    size_t maxDepth;
+    ExtensionBudget* extension;
+    DepthTerminator(size_t maxDepth, ExtensionBudget* extension = nullptr) : maxDepth(maxDepth), extension(extension) {}
+    inline TerminationCondition operator()(uint64_t board, size_t depth, Player player) const {
+        if(depth < maxDepth || (unlikely(extension != nullptr) && extension->extends(board, depth - maxDepth, player))) {
+            return TerminationCondition::CONTINUE;
+        }
+        return TerminationCondition::END;
+    }
+};
+
+/* like DepthTerminator, but aborts at the first node after the deadline */
+struct DeadlineTerminator {
+    size_t maxDepth;
+    std::chrono::steady_clock::time_point deadline;
+    ExtensionBudget* extension;
+    DeadlineTerminator(size_t maxDepth, std::chrono::steady_clock::time_point deadline, ExtensionBudget* extension = nullptr) : maxDepth(maxDepth), deadline(deadline), extension(extension) {}
+    inline TerminationCondition operator()(uint64_t board, size_t depth, Player player) const {
+        if(std::chrono::steady_clock::now() >= deadline) {
+            return TerminationCondition::ABORT;
+        } else if(depth >= maxDepth && !(unlikely(extension != nullptr) && extension->extends(board, depth - maxDepth, player))) {
+            return TerminationCondition::END;
+        } else {
+            return TerminationCondition::CONTINUE;
+        }
+    }
+};
+
+struct AllSpawns {
+    inline uint32_t select(uint64_t, size_t, size_t) const {
+        return ~(uint32_t)0;
+    }
+};
+
+struct SampledSpawns {
+    ChanceSampling sampling;
+    SampledSpawns(const ChanceSampling& sampling) : sampling(sampling) {}
+    inline uint32_t select(uint64_t afterstate, size_t depth, size_t numSpawns) const {
+        return sampling.applies(depth, numSpawns) ? sampleSpawns(afterstate, depth, numSpawns, sampling) : ~(uint32_t)0;
+    }
+};
+
+enum class ChanceModel : uint8_t {
+    MINIMAX,
+    EXPECTIMAX
+};
+
+enum class EvaluatorType : uint8_t {
+    HEURISTIC,
+    HEURISTIC_OLD,
+    ROW_TABLE
+};
+
+struct SearchOptions {
+    ChanceModel    chanceModel;
+    EvaluatorType  evaluator;
+    /* for EvaluatorType::ROW_TABLE, exactly one of these is set */
+    const RowWeightTable<float>*   floatTable;
+    const RowWeightTable<int16_t>* int16Table;
+    const RowWeightTable<int8_t>*  int8Table;
+    ChanceSampling sampling;
+    /* give every root move an exact value (see Search::rootMultiPV()) */
+    bool           multiPV;
+    /* split the root moves over this many threads (see Search::rootParallel()) */
+    size_t         rootThreads;
+    /* make parallel work reproducible (see Search::rootParallel() and runHeadless()) */
+    bool           deterministic;
+    /* probe a per-thread LeafCache before evaluating a leaf */
+    bool           leafCache;
+    /* search unstable leaves deeper (none if plies is 0) */
+    LeafExtension  extension;
+    SearchOptions() : chanceModel(ChanceModel::MINIMAX), evaluator(EvaluatorType::HEURISTIC), floatTable(nullptr), int16Table(nullptr), int8Table(nullptr), multiPV(false), rootThreads(1), deterministic(false), leafCache(true) {}
+};
 
-    AlphaBetaResult() : value(0), move(MoveType::GAMEOVER), terminationCondition(TerminationCondition::ABORT), prunedNodes(0) {}
-    AlphaBetaResult(int_fast64_t value, MoveType move, TerminationCondition terminationCondition, size_t prunedNodes) : value(value), move(move), terminationCondition(terminationCondition), prunedNodes(prunedNodes) {}
+/**
+ * A process-wide pool of threads for the parallel root searches.  A
+ * search hands its root moves to threads that already exist, and whose
+ * LeafCaches are still warm, instead of starting threads every move.
+ *
+ * run() queues a batch of tasks, runs the first one on the calling
+ * thread, and waits until the pool has finished the rest.  Batches of
+ * concurrent searches (of several headless workers, say) share the
+ * queue.  Pool threads block all signals, so they can be started
+ * before or after SignalWatcher::block().
+ */
+class WorkerPool {
+private:
+    struct Batch {
+        const std::function<void(size_t)>* task;
+        size_t next;
+        size_t count;
+        size_t unfinished;
+    };
+    std::mutex mutex;
+    std::condition_variable work;
+    std::condition_variable finished;
+    std::deque<Batch*> batches;
+    std::vector<std::thread> threads;
+    bool stopping;
+
+    void loop() {
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, nullptr);
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            work.wait(lock, [this]() { return stopping || !batches.empty(); });
+            if(batches.empty()) {
+                return;
+            }
+            Batch* batch = batches.front();
+            size_t index = batch->next++;
+            if(batch->next == batch->count) {
+                batches.pop_front();
+            }
+            lock.unlock();
+            (*batch->task)(index);
+            lock.lock();
+            if(--batch->unfinished == 0) {
+                finished.notify_all();
+            }
+        }
+    }
+public:
+    WorkerPool() : stopping(false) {}
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work.notify_all();
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    }
+    /* starts threads until there are at least numThreads */
+    void reserve(size_t numThreads) {
+        std::lock_guard<std::mutex> lock(mutex);
+        while(threads.size() < numThreads) {
+            threads.emplace_back(&WorkerPool::loop, this);
+        }
+    }
+    /* runs task(0), ..., task(count - 1), task(0) on the calling thread, and returns once all have finished */
+    void run(size_t count, const std::function<void(size_t)>& task) {
+        if(count == 0) {
+            return;
+        }
+        reserve(count - 1);
+        Batch batch = { &task, 1, count, count - 1 };
+        if(count > 1) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batches.push_back(&batch);
+            }
+            work.notify_all();
+        }
+        task(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&batch]() { return batch.unfinished == 0; });
+    }
 };
 
-AlphaBetaResult alphabeta(const Node& node, const std::function<TerminationCondition(const Node& node, size_t depth)>& terminateCondition, size_t depth, int_fast64_t alpha, int_fast64_t beta) {
-    auto condition = terminateCondition(node, depth);
-    if(condition == TerminationCondition::ABORT) {
-        return AlphaBetaResult(node.getPlayer() == Player::HUMAN ? alpha : beta, MoveType::GAMEOVER, condition, 0);
-    } else if(condition == TerminationCondition::END || node.isGameOver()) {
-        return AlphaBetaResult(node.getHeuristic(), MoveType::GAMEOVER, condition, 0);
+WorkerPool& workerPool() {
+    static WorkerPool pool;
+    return pool;
+}
+
+/**
+ * The probability-weighted average of the values below a chance node,
+ * in integer arithmetic, so that expectimax values are exact and the
+ * same with every compiler and on every platform.  The probability of
+ * a spawn is an integer weight (9 for a 2, 1 for a 4).  The high and
+ * low 32 bits of the values are summed separately, so a weighted value
+ * never overflows even for values near the limits of int_fast64_t, and
+ * add() is two independent 64-bit multiply-adds, without the x87 stack
+ * that long double needs on x86-64.  The total weight must stay below
+ * 2^24.
+ */
+class ChanceAverage {
+private:
+    int_fast64_t high;
+    int_fast64_t low;
+    int_fast64_t totalWeight;
+public:
+    static const int_fast64_t TWO_WEIGHT = 9;
+    static const int_fast64_t FOUR_WEIGHT = 1;
+    ChanceAverage() : high(0), low(0), totalWeight(0) {}
+    inline void add(int_fast64_t value, int_fast64_t weight) {
+        high += (value >> 32) * weight;
+        low += (value & 0xFFFFFFFF) * weight;
+        totalWeight += weight;
+    }
+    /* the average rounded half up, or 0 if nothing was added */
+    int_fast64_t rounded() const {
+        if(!totalWeight) {
+            return 0;
+        }
+        /* floor((2 * sum + totalWeight) / (2 * totalWeight)), divided 32 bits at a time */
+        int_fast64_t divisor = 2 * totalWeight;
+        int_fast64_t l = 2 * low + totalWeight;
+        int_fast64_t h = 2 * high + (l >> 32);
+        l &= 0xFFFFFFFF;
+        int_fast64_t quotientHigh = h / divisor - (h % divisor < 0);
+        int_fast64_t remainder = h - quotientHigh * divisor;
+        return quotientHigh * ((int_fast64_t)1 << 32) + ((remainder << 32) | l) / divisor;
     }
-    if(node.getPlayer() == Player::HUMAN) {
+};
+
+const int_fast64_t ChanceAverage::TWO_WEIGHT;
+const int_fast64_t ChanceAverage::FOUR_WEIGHT;
+
+/**
+ * The search works directly on packed boards: a max node expands the
+ * legal moves into afterstates with the row tables, and a chance node
+ * places each possible spawn on the afterstate.  Nothing is allocated
+ * per node.  The move and spawn orders match Node::getSuccessors().
+ */
+template<class Evaluator, class Terminator, class SpawnSelector, ChanceModel Model>
+class Search {
+private:
+    const Evaluator& evaluate;
+    const Terminator& terminate;
+    const SpawnSelector& spawns;
+    const MoveTables& tables;
+public:
+    Search(const Evaluator& evaluate, const Terminator& terminate, const SpawnSelector& spawns) : evaluate(evaluate), terminate(terminate), spawns(spawns), tables(getMoveTables()) {}
+
+    AlphaBetaResult max(uint64_t board, uint32_t score, size_t depth, int_fast64_t alpha, int_fast64_t beta) const {
+        auto condition = terminate(board, depth, Player::HUMAN);
+        if(condition == TerminationCondition::ABORT) {
+            return AlphaBetaResult(alpha, MoveType::GAMEOVER, condition, 0);
+        }
+        uint64_t afterstates[4];
+        uint32_t moveScores[4];
+        size_t numMoves = 0;
+        /* the game is over if we already have gotten 2048! */
+        if(likely(!containsExponent(board, 11))) {
+            for(size_t m=0; m<4; ++m) {
+                afterstates[m] = applyMove(tables, board, PLAYER_MOVES[m], moveScores[m]);
+                numMoves += afterstates[m] != board;
+            }
+        }
+        if(condition == TerminationCondition::END || !numMoves) {
+            return AlphaBetaResult(evaluate(board, score, !numMoves), MoveType::GAMEOVER, condition, 0);
+        }
         MoveType bestMove = MoveType::GAMEOVER;
         int_fast64_t bestValue = std::numeric_limits<int_fast64_t>::min();
-        size_t pruned = node.getSuccessors().size();
-        for(auto& succ : node.getSuccessors()) {
-            auto a = alphabeta(succ, terminateCondition, depth, alpha, beta);
+        size_t pruned = numMoves;
+        size_t nodes = 1;
+        for(size_t m=0; m<4; ++m) {
+            if(afterstates[m] == board) {
+                continue;
+            }
+            auto a = chance(afterstates[m], score + moveScores[m], depth, alpha, beta);
             alpha = std::max(alpha, a.value);
             pruned += a.prunedNodes;
             --pruned;
+            nodes += a.searchedNodes;
             if(a.value > bestValue || unlikely(bestMove == MoveType::GAMEOVER)) {
-                bestMove = succ.getMove();
+                bestMove = PLAYER_MOVES[m];
                 bestValue = a.value;
             }
             if(unlikely(a.terminationCondition == TerminationCondition::ABORT)) {
-                return AlphaBetaResult(alpha, bestMove, a.terminationCondition, pruned);
+                return AlphaBetaResult(alpha, bestMove, a.terminationCondition, pruned, nodes);
             } else if(beta <= alpha) {
-                succ.clearSuccessorCache();
                 break;
             }
         }
-        return AlphaBetaResult(alpha, bestMove, TerminationCondition::CONTINUE, pruned);
-    } else {
-#if 1
-        /* regular MiniMax: */
-        size_t pruned = node.getSuccessors().size();
-        for(auto& succ : node.getSuccessors()) {
-            auto b = alphabeta(succ, terminateCondition, depth + 1, alpha, beta);
-            beta = std::min(beta, b.value);
-            pruned += b.prunedNodes;
-            --pruned;
-            if(unlikely(b.terminationCondition == TerminationCondition::ABORT)) {
-                return AlphaBetaResult(beta, MoveType::GAMEOVER, b.terminationCondition, pruned);
-            } else if(beta <= alpha) {
-                succ.clearSuccessorCache();
-                break;
+        return AlphaBetaResult(alpha, bestMove, TerminationCondition::CONTINUE, pruned, nodes);
+    }
+
+    AlphaBetaResult chance(uint64_t afterstate, uint32_t score, size_t depth, int_fast64_t alpha, int_fast64_t beta) const {
+        auto condition = terminate(afterstate, depth, Player::RANDOM);
+        if(condition == TerminationCondition::ABORT) {
+            return AlphaBetaResult(beta, MoveType::GAMEOVER, condition, 0);
+        }
+        bool has2048 = containsExponent(afterstate, 11);
+        if(condition == TerminationCondition::END || unlikely(has2048)) {
+            return AlphaBetaResult(evaluate(afterstate, score, has2048), MoveType::GAMEOVER, condition, 0);
+        }
+        uint64_t empty = emptyCellMask(afterstate);
+        size_t numSpawns = 2 * __builtin_popcountll(empty);
+        uint32_t selected = spawns.select(afterstate, depth, numSpawns);
+        size_t pruned = numSpawns;
+        size_t nodes = 1;
+        size_t index = 0;
+        if(Model == ChanceModel::MINIMAX) {
+            for(; empty; empty &= empty - 1) {
+                for(uint64_t tile : {1, 2}) {
+                    if(!((selected >> index++) & 1)) {
+                        continue;
+                    }
+                    auto b = max(afterstate | (tile << __builtin_ctzll(empty)), score, depth + 1, alpha, beta);
+                    beta = std::min(beta, b.value);
+                    pruned += b.prunedNodes;
+                    --pruned;
+                    nodes += b.searchedNodes;
+                    if(unlikely(b.terminationCondition == TerminationCondition::ABORT)) {
+                        return AlphaBetaResult(beta, MoveType::GAMEOVER, b.terminationCondition, pruned, nodes);
+                    } else if(beta <= alpha) {
+                        return AlphaBetaResult(beta, MoveType::RAND, TerminationCondition::CONTINUE, pruned, nodes);
+                    }
+                }
+            }
+            return AlphaBetaResult(beta, MoveType::RAND, TerminationCondition::CONTINUE, pruned, nodes);
+        } else {
+            /*
+             * A fail-hard child only bounds its value, and an average of
+             * bounds is neither a value nor a bound, so every spawn is
+             * searched with the full window and the average is exact.
+             */
+            ChanceAverage average;
+            for(; empty; empty &= empty - 1) {
+                for(uint64_t tile : {1, 2}) {
+                    if(!((selected >> index++) & 1)) {
+                        continue;
+                    }
+                    auto b = max(afterstate | (tile << __builtin_ctzll(empty)), score, depth + 1, std::numeric_limits<int_fast64_t>::min(), std::numeric_limits<int_fast64_t>::max());
+                    pruned += b.prunedNodes;
+                    --pruned;
+                    nodes += b.searchedNodes;
+                    if(unlikely(b.terminationCondition == TerminationCondition::ABORT)) {
+                        return AlphaBetaResult(beta, MoveType::GAMEOVER, b.terminationCondition, pruned, nodes);
+                    }
+                    int_fast64_t weight = tile == 1 ? ChanceAverage::TWO_WEIGHT : ChanceAverage::FOUR_WEIGHT;
+                    average.add(b.value, weight);
+                }
+            }
+            return AlphaBetaResult(average.rounded(), MoveType::RAND, TerminationCondition::CONTINUE, pruned, nodes);
+        }
+    }
+
+    AlphaBetaResult root(const Node& node) const {
+        auto search = node.getPlayer() == Player::HUMAN ? &Search::max : &Search::chance;
+        return (this->*search)(node.getBoard().getRawBoard(), node.getScore(), 0, std::numeric_limits<int_fast64_t>::min(), std::numeric_limits<int_fast64_t>::max());
+    }
+
+    /**
+     * Multi-PV: searches every legal root move with a full window, each
+     * on its own thread, so that every move gets an exact value under
+     * either chance model.  The best move and its value are the same as
+     * root() would give, but without the narrowing window more nodes
+     * are searched.
+     */
+    AlphaBetaResult rootMultiPV(const Node& node) const {
+        uint64_t board = node.getBoard().getRawBoard();
+        if(node.getPlayer() != Player::HUMAN || containsExponent(board, 11)) {
+            return root(node);
+        }
+        AlphaBetaResult results[4];
+        LeafCacheCounts counts[4] = {};
+        uint64_t afterstates[4];
+        uint32_t scores[4];
+        size_t order[4];
+        size_t numMoves = 0;
+        uint_fast8_t legal = 0;
+        for(size_t m=0; m<4; ++m) {
+            uint32_t moveScore;
+            afterstates[m] = applyMove(tables, board, PLAYER_MOVES[m], moveScore);
+            scores[m] = node.getScore() + moveScore;
+            if(afterstates[m] != board) {
+                legal |= 1 << m;
+                order[numMoves++] = m;
             }
         }
-        return AlphaBetaResult(beta, MoveType::RAND, TerminationCondition::CONTINUE, pruned);
-#else 
-        /* ExpectiMax: */
-        long double average = 0.0;
-        auto& successors = node.getSuccessors();
-        bool twoAdded = true;
-        long double totalProbability = 0.0;
-        for(auto& succ : successors) {
-            long double probability = twoAdded ? 0.9 : 0.1;
-            twoAdded = !twoAdded;
-            totalProbability += probability;
-            average += (long double)alphabeta(succ, terminateCondition, depth + 1, alpha, beta).value * probability;
+        workerPool().run(numMoves, [&](size_t k) {
+                size_t m = order[k];
+                results[m] = chance(afterstates[m], scores[m], 0, std::numeric_limits<int_fast64_t>::min(), std::numeric_limits<int_fast64_t>::max());
+                counts[k] = takeLeafCacheCounts();
+            });
+        for(auto& c : counts) {
+            addLeafCacheCounts(c);
         }
-        if(totalProbability > 0.0) {
-            average /= totalProbability;
+        if(!legal) {
+            return root(node);
         }
-        return AlphaBetaResult(std::min(beta, (int_fast64_t)(average + 0.5)), MoveType::RAND, TerminationCondition::CONTINUE, 0);
-#endif
+        AlphaBetaResult result(std::numeric_limits<int_fast64_t>::min(), MoveType::GAMEOVER, TerminationCondition::CONTINUE, 0, 1);
+        for(size_t m=0; m<4; ++m) {
+            if(!(legal & (1 << m))) {
+                continue;
+            }
+            result.prunedNodes += results[m].prunedNodes;
+            result.searchedNodes += results[m].searchedNodes;
+            if(results[m].terminationCondition == TerminationCondition::ABORT) {
+                result.terminationCondition = TerminationCondition::ABORT;
+            }
+            result.moveValues[m] = results[m].value;
+            result.valuedMoves |= 1 << m;
+            if(results[m].value > result.value || result.move == MoveType::GAMEOVER) {
+                result.value = results[m].value;
+                result.move = PLAYER_MOVES[m];
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Parallel root split: the first legal move is searched with the
+     * full window, then the others are shared out among numThreads
+     * threads.
+     *
+     * Normally a thread takes the next move whenever it becomes free and
+     * searches it with the best value any thread has found so far.  That
+     * prunes the most, but the node counts depend on the timing, and as
+     * the values are fail-hard bounds a move can tie with a later move's
+     * value and be picked instead of it.
+     *
+     * With deterministic set, the k-th remaining move always goes to
+     * thread k % numThreads and is searched with the first move's value
+     * as alpha, and the results are combined in move order.  A smaller
+     * alpha than root() would use only loosens the bound on a minimax
+     * move that loses anyway, and expectimax values do not depend on
+     * the window, so the move and value are the same as root()'s.
+     */
+    AlphaBetaResult rootParallel(const Node& node, size_t numThreads, bool deterministic) const {
+        uint64_t board = node.getBoard().getRawBoard();
+        if(node.getPlayer() != Player::HUMAN || containsExponent(board, 11) || numThreads < 2) {
+            return root(node);
+        }
+        uint64_t afterstates[4];
+        uint32_t scores[4];
+        size_t order[4];
+        size_t numMoves = 0;
+        for(size_t m=0; m<4; ++m) {
+            uint32_t moveScore;
+            afterstates[m] = applyMove(tables, board, PLAYER_MOVES[m], moveScore);
+            scores[m] = node.getScore() + moveScore;
+            if(afterstates[m] != board) {
+                order[numMoves++] = m;
+            }
+        }
+        if(numMoves < 2) {
+            return root(node);
+        }
+        AlphaBetaResult results[4];
+        results[0] = chance(afterstates[order[0]], scores[order[0]], 0, std::numeric_limits<int_fast64_t>::min(), std::numeric_limits<int_fast64_t>::max());
+        if(results[0].terminationCondition != TerminationCondition::ABORT) {
+            std::atomic<int_fast64_t> sharedAlpha(results[0].value);
+            std::atomic<size_t> nextMove(1);
+            LeafCacheCounts counts[4] = {};
+            workerPool().run(std::min(numThreads, numMoves - 1), [&](size_t t) {
+                    for(size_t k = deterministic ? 1 + t : nextMove++; k < numMoves; k = deterministic ? k + numThreads : nextMove++) {
+                        int_fast64_t alpha = deterministic ? results[0].value : sharedAlpha.load();
+                        results[k] = chance(afterstates[order[k]], scores[order[k]], 0, alpha, std::numeric_limits<int_fast64_t>::max());
+                        int_fast64_t best = sharedAlpha.load();
+                        while(!deterministic && results[k].value > best && !sharedAlpha.compare_exchange_weak(best, results[k].value)) {
+                            /* best now holds the value another thread published */
+                        }
+                    }
+                    counts[t] = takeLeafCacheCounts();
+                });
+            for(auto& c : counts) {
+                addLeafCacheCounts(c);
+            }
+        }
+        AlphaBetaResult result(std::numeric_limits<int_fast64_t>::min(), MoveType::GAMEOVER, TerminationCondition::CONTINUE, 0, 1);
+        for(size_t k=0; k<numMoves; ++k) {
+            result.prunedNodes += results[k].prunedNodes;
+            result.searchedNodes += results[k].searchedNodes;
+            if(results[k].value > result.value || result.move == MoveType::GAMEOVER) {
+                result.value = results[k].value;
+                result.move = PLAYER_MOVES[order[k]];
+            }
+            if(unlikely(results[k].terminationCondition == TerminationCondition::ABORT)) {
+                result.terminationCondition = TerminationCondition::ABORT;
+                break;
+            }
+        }
+        return result;
+    }
+};
+
+template<class Evaluator, class Terminator, class SpawnSelector, ChanceModel Model>
+AlphaBetaResult searchWith(const Node& node, const Search<Evaluator,Terminator,SpawnSelector,Model>& search, const SearchOptions& options) {
+    if(options.multiPV) {
+        return search.rootMultiPV(node);
+    } else if(options.rootThreads > 1) {
+        return search.rootParallel(node, options.rootThreads, options.deterministic);
+    } else {
+        return search.root(node);
     }
 }
 
-inline AlphaBetaResult alphabeta(const Node& node, const std::function<TerminationCondition(const Node& node, size_t depth)>& terminateCondition) {
-    return alphabeta(node, terminateCondition, 0, std::numeric_limits<int_fast64_t>::min(), std::numeric_limits<int_fast64_t>::max());
+template<class Evaluator, class Terminator, class SpawnSelector>
+AlphaBetaResult searchWith(const Node& node, const Evaluator& evaluate, const Terminator& terminate, const SpawnSelector& spawns, const SearchOptions& options) {
+    if(options.chanceModel == ChanceModel::EXPECTIMAX) {
+        return searchWith(node, Search<Evaluator,Terminator,SpawnSelector,ChanceModel::EXPECTIMAX>(evaluate, terminate, spawns), options);
+    } else {
+        return searchWith(node, Search<Evaluator,Terminator,SpawnSelector,ChanceModel::MINIMAX>(evaluate, terminate, spawns), options);
+    }
 }
 
-AlphaBetaResult suggestMoveParallel(const Node& node, const std::function<TerminationCondition(const Node& node, size_t depth)>& terminateCondition) {
-    int_fast64_t bestScore = -1;
-    MoveType suggestedMove = MoveType::START;
-    for(auto& succ : node.getSuccessors()) {
-        auto ab = alphabeta(succ, terminateCondition);
-        if(unlikely(ab.terminationCondition == TerminationCondition::ABORT)) {
-            return AlphaBetaResult(bestScore, suggestedMove, TerminationCondition::ABORT, 0);
-        }
-        if(ab.value > bestScore) {
-            bestScore = ab.value;
-            suggestedMove = succ.getMove();
+template<class Evaluator, class Terminator>
+AlphaBetaResult searchWithSampling(const Node& node, const Evaluator& evaluate, const Terminator& terminate, const SearchOptions& options) {
+    if(options.sampling.depth != NO_CHANCE_SAMPLING.depth) {
+        return searchWith(node, evaluate, terminate, SampledSpawns(options.sampling), options);
+    } else {
+        return searchWith(node, evaluate, terminate, AllSpawns(), options);
+    }
+}
+template<class Evaluator, class Terminator>
+AlphaBetaResult searchWith(const Node& node, const Evaluator& evaluate, const Terminator& terminate, const SearchOptions& options) {
+    if(options.leafCache) {
+        return searchWithSampling(node, CachedEvaluator<Evaluator>(evaluate), terminate, options);
+    } else {
+        return searchWithSampling(node, evaluate, terminate, options);
+    }
+}
+
+template<class Terminator>
+AlphaBetaResult searchWith(const Node& node, const Terminator& terminate, const SearchOptions& options) {
+    switch(options.evaluator) {
+    case EvaluatorType::HEURISTIC_OLD:
+        return searchWith(node, OldHeuristicEvaluator(), terminate, options);
+    case EvaluatorType::ROW_TABLE:
+        if(options.int8Table) {
+            return searchWith(node, RowTableEvaluator<int8_t>(options.int8Table), terminate, options);
+        } else if(options.int16Table) {
+            return searchWith(node, RowTableEvaluator<int16_t>(options.int16Table), terminate, options);
+        } else {
+            return searchWith(node, RowTableEvaluator<float>(options.floatTable), terminate, options);
         }
+    case EvaluatorType::HEURISTIC:
+    default:
+        return searchWith(node, HeuristicEvaluator(), terminate, options);
     }
-    return AlphaBetaResult(bestScore, suggestedMove, TerminationCondition::CONTINUE, 0);
 }
 
-inline AlphaBetaResult suggestMove(const Node& node, const std::function<TerminationCondition(const Node& node, size_t depth)>& terminateCondition) {
-    return alphabeta(node, terminateCondition);
+inline AlphaBetaResult suggestMove(const Node& node, size_t maxDepth, const SearchOptions& options = SearchOptions()) {
+    ExtensionBudget extension(options.extension);
+    return searchWith(node, DepthTerminator(maxDepth, options.extension.plies ? &extension : nullptr), options);
 }
 
-inline AlphaBetaResult suggestMove(const Node& node, size_t maxDepth) {
-    return suggestMove(node, [maxDepth](const Node&, size_t depth) -> TerminationCondition { return depth >= maxDepth ? TerminationCondition::END : TerminationCondition::CONTINUE; });
+/* the move whose afterstate evaluates best, for when there is no time to search */
+AlphaBetaResult suggestStaticMove(const Node& node, const SearchOptions& options = SearchOptions()) {
+    SearchOptions leaves = options;
+    leaves.extension = LeafExtension();
+    AlphaBetaResult best(std::numeric_limits<int_fast64_t>::min(), MoveType::GAMEOVER, TerminationCondition::CONTINUE, 0, 1);
+    if(node.getPlayer() != Player::HUMAN) {
+        return best;
+    }
+    for(auto& succ : node.getSuccessors()) {
+        /* a chance node at the nominal depth is a leaf */
+        auto leaf = suggestMove(succ, 0, leaves);
+        best.searchedNodes += leaf.searchedNodes;
+        if(leaf.value > best.value || best.move == MoveType::GAMEOVER) {
+            best.value = leaf.value;
+            best.move = succ.getMove();
+        }
+    }
+    return best;
 }
 
 typedef std::function<void(size_t maxDepth,const AlphaBetaResult& result)> AlphaBetaCallback;
 
-AlphaBetaResult suggestMoveWithDeadline(const Node& node, unsigned long deadlineInMs, const AlphaBetaCallback& statusCallback = [](size_t, const AlphaBetaResult&) {}) {
-    auto startTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+/**
+ * Iterative deepening from depth 1 until deadlineInUs microseconds
+ * have passed, on the monotonic clock.  Every iteration can be
+ * aborted: the terminator looks at the clock at every node, so the
+ * search unwinds within about one node expansion of the deadline.  If
+ * not even depth 1 finishes, the answer is suggestStaticMove() (and
+ * the callback sees depth 0), which takes a few evaluations.
+ */
+AlphaBetaResult suggestMoveWithDeadline(const Node& node, unsigned long deadlineInUs, const AlphaBetaCallback& statusCallback = [](size_t, const AlphaBetaResult&) {}, const SearchOptions& options = SearchOptions()) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(deadlineInUs);
 
     AlphaBetaResult bestSuggestion;
-    const size_t startingDepth = 2;
-    for(size_t maxDepth = startingDepth;; ++maxDepth) {
-        auto newSuggestion = suggestMove(node, [startingDepth,maxDepth,startTime,deadlineInMs](const Node&, size_t depth) -> TerminationCondition {
-                if(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - startTime >= (long long)deadlineInMs && maxDepth > startingDepth) {
-                    return TerminationCondition::ABORT;
-                } else if(depth >= maxDepth) {
-                    return TerminationCondition::END;
-                } else {
-                    return TerminationCondition::CONTINUE;
-                }
-            });
-        if(newSuggestion.terminationCondition == TerminationCondition::ABORT && maxDepth > startingDepth) {
+    /* over all iterations, including the aborted one */
+    size_t searchedNodes = 0;
+    size_t maxDepth = 1;
+    for(;; ++maxDepth) {
+        ExtensionBudget extension(options.extension);
+        auto newSuggestion = searchWith(node, DeadlineTerminator(maxDepth, deadline, options.extension.plies ? &extension : nullptr), options);
+        searchedNodes += newSuggestion.searchedNodes;
+        if(newSuggestion.terminationCondition == TerminationCondition::ABORT) {
             break;
         } else {
             bestSuggestion = newSuggestion;
             statusCallback(maxDepth, bestSuggestion);
         }
     }
+    if(maxDepth == 1) {
+        bestSuggestion = suggestStaticMove(node, options);
+        searchedNodes += bestSuggestion.searchedNodes;
+        statusCallback(0, bestSuggestion);
+    }
+    bestSuggestion.searchedNodes = searchedNodes;
     return bestSuggestion;
 }
 
-#if USE_CURSES
-MoveType printState(const Node& node, unsigned long aiTimeout) {
-    clear();
-    std::stringstream ss;
-    ss << node;
-    int height, width;
-    getmaxyx(stdscr,height,width);
-    std::string fileLine;
-    std::list<std::string> lines;
-    while(std::getline(ss, fileLine)) {
-        /* remove the newline */
-        lines.push_back(fileLine);//.substr(0, fileLine.size()-1));
+enum class ProofResult : uint8_t {
+    PROVEN,
+    DISPROVEN,
+    UNKNOWN
+};
+
+struct SurvivalProof {
+    ProofResult result;
+    /* if PROVEN, a move that survives (GAMEOVER if no more moves are needed) */
+    MoveType    move;
+    /* nodes expanded */
+    size_t      nodes;
+};
+
+/**
+ * Proves or disproves that the player can make a number of moves more
+ * whatever spawns, wherever they spawn: the spawns are the worst-case
+ * opponent of ChanceModel::MINIMAX.  Reaching 2048 ends the game, so
+ * it counts as surviving.
+ *
+ * This is depth-first proof-number search (df-pn, Nagai 2002).  A
+ * position with the player to move is proven if one of its afterstates
+ * is, and an afterstate if all of its spawns are.  The proof and
+ * disproof numbers of a node count the leaves that would still have to
+ * be settled to prove or disprove it, and the search always expands
+ * the most-proving leaf, so one surviving line or one killing spawn is
+ * found without searching its siblings the way a fixed-order search
+ * would.  The numbers are kept in a transposition table keyed by the
+ * board, the moves left and the node type.  Tile sums only grow, so
+ * the game has no cycles to get the table wrong.  Unlike LeafCache, the
+ * table never drops an entry: df-pn goes back to the same nodes again
+ * and again, and two nodes that keep evicting each other's numbers can
+ * loop until the budget runs out.  It grows instead (open addressing
+ * with linear probing), to at most four entries per node expanded.
+ *
+ * A prover is not thread-safe; its table stays valid from one prove()
+ * to the next.
+ */
+class SurvivalProver {
+public:
+    static const unsigned DEFAULT_BITS = 16;
+private:
+    static const uint32_t INFINITE = (uint32_t)1 << 30;
+    struct Entry {
+        uint64_t board;
+        /* 0 if empty, else 2 * moves left + 1 for a position with the player to move, + 2 for an afterstate */
+        uint32_t tag;
+        uint32_t proof;
+        uint32_t disproof;
+    };
+    const MoveTables& tables;
+    std::vector<Entry> entries;
+    unsigned initialBits;
+    unsigned bits;
+    size_t used;
+    size_t nodes;
+    size_t budget;
+
+    static inline uint32_t tagOf(size_t movesLeft, bool afterstate) {
+        return 2 * (uint32_t)movesLeft + 1 + afterstate;
     }
-    bool gameOver = node.isGameOver();
-    if(gameOver) {
-        mvprintw((height - lines.size())/2 - 3,(width - 10)/2,"Game Over!");
-        mvprintw((height - lines.size())/2 - 2,(width - 18)/2,"Final Score: %d",node.getScore());
-        mvprintw(height - 2,(width - 21)/2,"Press Any Key to Quit");
-    } else {
-        mvprintw((height - lines.size())/2 - 2,(width - 12)/2,"Score: %d",node.getScore());
+    /* the entry of the key, or the empty one where it would go */
+    inline Entry& entryFor(uint64_t board, uint32_t tag) {
+        size_t mask = entries.size() - 1;
+        size_t index = ((board ^ ((uint64_t)tag << 48)) * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+        while(entries[index].tag && (entries[index].board != board || entries[index].tag != tag)) {
+            index = (index + 1) & mask;
+        }
+        return entries[index];
     }
-    int i = 0;
-    for(auto& line : lines) {
-        mvprintw((height - lines.size())/2 + i++,(width-line.length())/2,"%s",line.c_str());
+    void grow() {
+        std::vector<Entry> old((size_t)2 << bits, Entry{ 0, 0, 0, 0 });
+        old.swap(entries);
+        ++bits;
+        for(auto& entry : old) {
+            if(entry.tag) {
+                entryFor(entry.board, entry.tag) = entry;
+            }
+        }
     }
-
-    if(gameOver) {
-        return Move::START;
+    static inline uint32_t saturatingAdd(uint32_t a, uint32_t b) {
+        return std::min(a + b, INFINITE);
+    }
+    /* the numbers of a node from the table, or an estimate if it has not been expanded yet */
+    inline void lookup(uint64_t board, size_t movesLeft, bool afterstate, uint32_t& proof, uint32_t& disproof) {
+        if(movesLeft == 0 || containsExponent(board, 11)) {
+            proof = 0;
+            disproof = INFINITE;
+            return;
+        }
+        uint32_t tag = tagOf(movesLeft, afterstate);
+        const Entry& entry = entryFor(board, tag);
+        if(entry.tag) {
+            proof = entry.proof;
+            disproof = entry.disproof;
+        } else {
+            /* every spawn of an afterstate has to be proven */
+            proof = afterstate ? 2 * __builtin_popcountll(emptyCellMask(board)) : 1;
+            disproof = 1;
+        }
+    }
+    inline void store(uint64_t board, size_t movesLeft, bool afterstate, uint32_t proof, uint32_t disproof) {
+        uint32_t tag = tagOf(movesLeft, afterstate);
+        Entry* entry = &entryFor(board, tag);
+        if(!entry->tag) {
+            /* at most half full, so the probes stay short */
+            if(2 * ++used > entries.size()) {
+                grow();
+                entry = &entryFor(board, tag);
+            }
+        }
+        *entry = Entry{ board, tag, proof, disproof };
+    }
+
+    /**
+     * Expands the node until its proof number reaches proofThreshold or
+     * its disproof number disproofThreshold, or the budget runs out.
+     * The node is not terminal.  Returns in best the child that the
+     * search would expand next: at a proven position, a surviving move.
+     */
+    void search(uint64_t board, size_t movesLeft, bool afterstate, uint32_t proofThreshold, uint32_t disproofThreshold, uint32_t& proof, uint32_t& disproof, size_t& best) {
+        ++nodes;
+        uint64_t children[32];
+        size_t numChildren = 0;
+        if(afterstate) {
+            for(uint64_t empty = emptyCellMask(board); empty; empty &= empty - 1) {
+                for(uint64_t tile : {1, 2}) {
+                    children[numChildren++] = board | (tile << __builtin_ctzll(empty));
+                }
+            }
+        } else {
+            size_t numMoves = 0;
+            for(size_t m=0; m<4; ++m) {
+                uint32_t score;
+                children[m] = applyMove(tables, board, PLAYER_MOVES[m], score);
+                numMoves += children[m] != board;
+            }
+            /* the illegal moves are skipped below */
+            numChildren = numMoves ? 4 : 0;
+        }
+        best = 0;
+        if(!numChildren) {
+            proof = INFINITE;
+            disproof = 0;
+            store(board, movesLeft, afterstate, proof, disproof);
+            return;
+        }
+        /* an afterstate's spawns have as many moves left as it does */
+        size_t childMovesLeft = afterstate ? movesLeft : movesLeft - 1;
+        /* only the child searched last changes (but for transpositions, which just cost some extra work) */
+        uint32_t proofs[32];
+        uint32_t disproofs[32];
+        for(size_t c=0; c<numChildren; ++c) {
+            lookup(children[c], childMovesLeft, !afterstate, proofs[c], disproofs[c]);
+        }
+        for(;;) {
+            /* at a position with the player to move, the children are ORed: proven by any, disproven by all */
+            uint32_t sum = 0;
+            uint32_t first = INFINITE + 1;
+            uint32_t second = INFINITE + 1;
+            uint32_t bestSummed = 0;
+            for(size_t c=0; c<numChildren; ++c) {
+                if(!afterstate && children[c] == board) {
+                    continue;
+                }
+                uint32_t minimized = afterstate ? disproofs[c] : proofs[c];
+                uint32_t summed = afterstate ? proofs[c] : disproofs[c];
+                sum = saturatingAdd(sum, summed);
+                if(minimized < first) {
+                    second = first;
+                    first = minimized;
+                    best = c;
+                    bestSummed = summed;
+                } else if(minimized < second) {
+                    second = minimized;
+                }
+            }
+            proof = afterstate ? sum : first;
+            disproof = afterstate ? first : sum;
+            if(proof >= proofThreshold || disproof >= disproofThreshold || nodes >= budget) {
+                break;
+            }
+            uint32_t minimizedThreshold = afterstate ? disproofThreshold : proofThreshold;
+            uint32_t summedThreshold = afterstate ? proofThreshold : disproofThreshold;
+            /* a little over the second best (the 1 + epsilon trick), so that the search does not switch back and forth between two children */
+            uint32_t childMinimizedThreshold = std::min(minimizedThreshold, saturatingAdd(second, second / 4 + 1));
+            uint32_t childSummedThreshold = std::min(summedThreshold - sum + bestSummed, INFINITE);
+            size_t childBest;
+            search(children[best], childMovesLeft, !afterstate,
+                   afterstate ? childSummedThreshold : childMinimizedThreshold,
+                   afterstate ? childMinimizedThreshold : childSummedThreshold,
+                   proofs[best], disproofs[best], childBest);
+        }
+        store(board, movesLeft, afterstate, proof, disproof);
+    }
+
+    /* the fixed-order search of searchFixedOrder() */
+    ProofResult fixedOrder(uint64_t board, size_t movesLeft, bool afterstate) {
+        if(movesLeft == 0 || containsExponent(board, 11)) {
+            return ProofResult::PROVEN;
+        } else if(nodes >= budget) {
+            return ProofResult::UNKNOWN;
+        }
+        ++nodes;
+        bool unknown = false;
+        if(afterstate) {
+            for(uint64_t empty = emptyCellMask(board); empty; empty &= empty - 1) {
+                for(uint64_t tile : {1, 2}) {
+                    auto result = fixedOrder(board | (tile << __builtin_ctzll(empty)), movesLeft, false);
+                    if(result == ProofResult::DISPROVEN) {
+                        return result;
+                    }
+                    unknown = unknown || result == ProofResult::UNKNOWN;
+                }
+            }
+            return unknown ? ProofResult::UNKNOWN : ProofResult::PROVEN;
+        }
+        for(size_t m=0; m<4; ++m) {
+            uint32_t score;
+            uint64_t child = applyMove(tables, board, PLAYER_MOVES[m], score);
+            if(child == board) {
+                continue;
+            }
+            auto result = fixedOrder(child, movesLeft - 1, true);
+            if(result == ProofResult::PROVEN) {
+                return result;
+            }
+            unknown = unknown || result == ProofResult::UNKNOWN;
+        }
+        return unknown ? ProofResult::UNKNOWN : ProofResult::DISPROVEN;
+    }
+public:
+    explicit SurvivalProver(unsigned bits = DEFAULT_BITS) : tables(getMoveTables()), initialBits(bits), bits(bits), used(0), nodes(0), budget(0) {
+        clear();
+    }
+    /* forgets every entry and shrinks the table back to its initial size */
+    void clear() {
+        std::vector<Entry>((size_t)1 << initialBits, Entry{ 0, 0, 0, 0 }).swap(entries);
+        bits = initialBits;
+        used = 0;
+    }
+    /* whether the player to move on board can make moves more moves, expanding at most nodeBudget nodes */
+    SurvivalProof prove(uint64_t board, size_t moves, size_t nodeBudget) {
+        nodes = 0;
+        budget = nodeBudget;
+        uint32_t proof, disproof;
+        lookup(board, moves, false, proof, disproof);
+        if(proof == 0) {
+            return SurvivalProof{ ProofResult::PROVEN, MoveType::GAMEOVER, 0 };
+        }
+        size_t best;
+        search(board, moves, false, INFINITE, INFINITE, proof, disproof, best);
+        if(proof == 0) {
+            return SurvivalProof{ ProofResult::PROVEN, PLAYER_MOVES[best], nodes };
+        }
+        return SurvivalProof{ disproof == 0 ? ProofResult::DISPROVEN : ProofResult::UNKNOWN, MoveType::GAMEOVER, nodes };
+    }
+    /**
+     * The same question answered by a depth-first alpha-beta search over
+     * the moves and spawns in their usual order, without a table: the
+     * MINIMAX search on a survived-or-not value.  For comparison.
+     */
+    SurvivalProof searchFixedOrder(uint64_t board, size_t moves, size_t nodeBudget) {
+        nodes = 0;
+        budget = nodeBudget;
+        return SurvivalProof{ fixedOrder(board, moves, false), MoveType::GAMEOVER, nodes };
+    }
+};
+
+const unsigned SurvivalProver::DEFAULT_BITS;
+const uint32_t SurvivalProver::INFINITE;
+
+/**
+ * The rules on a board of width x height cells (up to 4 x 4), kept in
+ * the top-left corner of a packed board so that the row tables apply:
+ * a line of fewer than four cells, with empty cells on the side its
+ * tiles slide away from, moves exactly like a full one.  For the moves
+ * right and down, the board is shifted to the right or the bottom
+ * first, and back afterwards.
+ */
+class SmallBoardRules {
+private:
+    const MoveTables& tables;
+    unsigned rightShift;
+    unsigned downShift;
+    /* bit 4*i is set iff cell i is on the board */
+    uint64_t cellBits;
+public:
+    const size_t width;
+    const size_t height;
+    SmallBoardRules(size_t width, size_t height) : tables(getMoveTables()), rightShift(4 * (4 - (unsigned)width)), downShift(16 * (4 - (unsigned)height)), cellBits(0), width(width), height(height) {
+        for(size_t row=0; row<height; ++row) {
+            for(size_t col=0; col<width; ++col) {
+                cellBits |= (uint64_t)1 << (16 * row + 4 * col);
+            }
+        }
+    }
+    inline uint64_t move(uint64_t board, MoveType move, uint32_t& score) const {
+        switch(move) {
+        case MoveType::RIGHT:
+            return applyMove(tables, board << rightShift, move, score) >> rightShift;
+        case MoveType::DOWN:
+            return applyMove(tables, board << downShift, move, score) >> downShift;
+        default:
+            return applyMove(tables, board, move, score);
+        }
+    }
+    inline uint64_t emptyCells(uint64_t board) const {
+        return emptyCellMask(board) & cellBits;
+    }
+    /* the board mirrored left to right, back in the top-left corner */
+    inline uint64_t mirrored(uint64_t board) const {
+        board = ((board >> 8) & 0x00FF00FF00FF00FFULL) | ((board & 0x00FF00FF00FF00FFULL) << 8);
+        board = ((board >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((board & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return board >> rightShift;
+    }
+    /* the board flipped top to bottom, back in the top-left corner */
+    inline uint64_t flipped(uint64_t board) const {
+        board = (board >> 32) | (board << 32);
+        board = ((board >> 16) & 0x0000FFFF0000FFFFULL) | ((board & 0x0000FFFF0000FFFFULL) << 16);
+        return board >> downShift;
+    }
+    /**
+     * The least of the board's images under the symmetries of the
+     * rectangle: the mirror images, and for a square board the
+     * transposes too.  The game looks the same from each of them, so
+     * symmetric positions share one canonical board.
+     */
+    inline uint64_t canonical(uint64_t board) const {
+        uint64_t flip = flipped(board);
+        uint64_t least = std::min(std::min(board, mirrored(board)), std::min(flip, mirrored(flip)));
+        if(width == height) {
+            uint64_t transpose = transposeBoard(board);
+            uint64_t flipTranspose = flipped(transpose);
+            least = std::min(least, std::min(std::min(transpose, mirrored(transpose)), std::min(flipTranspose, mirrored(flipTranspose))));
+        }
+        return least;
+    }
+    /* the boards a game starts with, all equally likely: as Node(seed) deals them, two different cells of a 2 or a 4 each */
+    std::vector<uint64_t> startBoards() const {
+        std::vector<uint64_t> boards;
+        for(uint64_t first = cellBits; first; first &= first - 1) {
+            for(uint64_t second = first & (first - 1); second; second &= second - 1) {
+                for(uint64_t a : {1, 2}) {
+                    for(uint64_t b : {1, 2}) {
+                        boards.push_back((a << __builtin_ctzll(first)) | (b << __builtin_ctzll(second)));
+                    }
+                }
+            }
+        }
+        return boards;
+    }
+};
+
+/* the sum of the tiles on a packed board */
+inline uint64_t tileSum(uint64_t board) {
+    uint64_t sum = 0;
+    for(; board; board >>= 4) {
+        sum += (board & 0b1111) ? (uint64_t)1 << (board & 0b1111) : 0;
+    }
+    return sum;
+}
+
+/**
+ * Solves the game exactly on a small board: the expected score that
+ * perfect play still gains from every reachable position with the
+ * player to move, with a 2 (probability 0.9) or a 4 (0.1) spawning on
+ * a uniformly chosen empty cell.  As in the search, a position with
+ * 2048 on it ends the game.
+ *
+ * A move keeps the sum of the tiles and a spawn adds 2 or 4 to it, so
+ * the positions fall into layers by tile sum, and a layer's successors
+ * all lie in the next two.  solve() enumerates the layers forward from
+ * the start boards (a breadth-first search, each layer split over the
+ * threads), and then computes the values backward a layer at a time
+ * from the two above it: retrograde analysis that settles every value
+ * in one pass, without iterating to convergence.
+ *
+ * Symmetric positions have the same value, so only canonical boards
+ * (SmallBoardRules::canonical()) are kept: up to 8 times fewer on a
+ * square board.  A layer is a dense index: its boards are split into
+ * buckets by a hash and sorted within each, so a position costs its
+ * 8-byte board, and a board's index (and value) is found by binary
+ * search in its bucket.  Values are only kept for the layer being
+ * solved and the two it reads, and a layer's boards are freed once no
+ * layer below needs them.
+ */
+class SmallBoardSolver {
+public:
+    static const unsigned BUCKET_BITS = 6;
+    static const size_t NUM_BUCKETS = (size_t)1 << BUCKET_BITS;
+    struct Layer {
+        std::vector<uint64_t> boards;
+        /* bucket b is boards[bucketStart[b], bucketStart[b + 1]) */
+        size_t bucketStart[NUM_BUCKETS + 1];
+        /* the board must be in the layer */
+        inline size_t indexOf(uint64_t board) const {
+            size_t bucket = bucketOf(board);
+            return std::lower_bound(boards.begin() + bucketStart[bucket], boards.begin() + bucketStart[bucket + 1], board) - boards.begin();
+        }
+    };
+    typedef std::function<void(const Layer& layer, const std::vector<double>& values)> LayerCallback;
+private:
+    SmallBoardRules rules;
+    size_t numThreads;
+    /* by tile sum / 2 */
+    std::vector<Layer> layers;
+    size_t numStates;
+
+    static inline size_t bucketOf(uint64_t board) {
+        return (board * 0x9E3779B97F4A7C15ULL) >> (64 - BUCKET_BITS);
+    }
+
+    void enumerate() {
+        typedef std::vector<std::vector<uint64_t>> Buckets;
+        std::vector<Buckets> pending;
+        for(auto board : rules.startBoards()) {
+            board = rules.canonical(board);
+            size_t layer = tileSum(board) / 2;
+            pending.resize(std::max(pending.size(), layer + 1), Buckets(NUM_BUCKETS));
+            pending[layer][bucketOf(board)].push_back(board);
+        }
+        layers.clear();
+        numStates = 0;
+        for(size_t l=0; l<pending.size(); ++l) {
+            Buckets buckets;
+            buckets.swap(pending[l]);
+            workerPool().run(numThreads, [&](size_t thread) {
+                for(size_t b=thread; b<NUM_BUCKETS; b+=numThreads) {
+                    std::sort(buckets[b].begin(), buckets[b].end());
+                    buckets[b].erase(std::unique(buckets[b].begin(), buckets[b].end()), buckets[b].end());
+                }
+            });
+            layers.emplace_back();
+            Layer& layer = layers.back();
+            layer.bucketStart[0] = 0;
+            for(size_t b=0; b<NUM_BUCKETS; ++b) {
+                layer.bucketStart[b + 1] = layer.bucketStart[b] + buckets[b].size();
+            }
+            layer.boards.reserve(layer.bucketStart[NUM_BUCKETS]);
+            for(auto& bucket : buckets) {
+                layer.boards.insert(layer.boards.end(), bucket.begin(), bucket.end());
+                std::vector<uint64_t>().swap(bucket);
+            }
+            numStates += layer.boards.size();
+            /* a spawned 2 leads to layer l + 1 and a 4 to layer l + 2 */
+            pending.resize(std::max(pending.size(), l + 3), Buckets(NUM_BUCKETS));
+            std::mutex mutex;
+            workerPool().run(numThreads, [&](size_t thread) {
+                Buckets next[2] = { Buckets(NUM_BUCKETS), Buckets(NUM_BUCKETS) };
+                size_t end = (thread + 1) * layer.boards.size() / numThreads;
+                for(size_t i=thread*layer.boards.size()/numThreads; i<end; ++i) {
+                    uint64_t board = layer.boards[i];
+                    if(containsExponent(board, 11)) {
+                        continue;
+                    }
+                    for(size_t m=0; m<4; ++m) {
+                        uint32_t score;
+                        uint64_t afterstate = rules.move(board, PLAYER_MOVES[m], score);
+                        if(afterstate == board) {
+                            continue;
+                        }
+                        for(uint64_t empty = rules.emptyCells(afterstate); empty; empty &= empty - 1) {
+                            for(uint64_t tile : {1, 2}) {
+                                uint64_t spawned = rules.canonical(afterstate | (tile << __builtin_ctzll(empty)));
+                                next[tile - 1][bucketOf(spawned)].push_back(spawned);
+                            }
+                        }
+                    }
+                }
+                for(auto& buckets : next) {
+                    for(auto& bucket : buckets) {
+                        std::sort(bucket.begin(), bucket.end());
+                        bucket.erase(std::unique(bucket.begin(), bucket.end()), bucket.end());
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                for(size_t t=0; t<2; ++t) {
+                    for(size_t b=0; b<NUM_BUCKETS; ++b) {
+                        auto& into = pending[l + 1 + t][b];
+                        into.insert(into.end(), next[t][b].begin(), next[t][b].end());
+                    }
+                }
+            });
+            while(pending.size() > l + 1 && std::all_of(pending.back().begin(), pending.back().end(), [](const std::vector<uint64_t>& bucket) { return bucket.empty(); })) {
+                pending.pop_back();
+            }
+        }
+        /* the layers that the top ones would read */
+        layers.resize(layers.size() + 2);
+        for(size_t l=layers.size()-2; l<layers.size(); ++l) {
+            std::fill(layers[l].bucketStart, layers[l].bucketStart + NUM_BUCKETS + 1, 0);
+        }
+    }
+
+    /* a position of layer l, from the values of layers l + 1 and l + 2 */
+    double valueOf(uint64_t board, size_t l, const std::vector<double>& plusTwo, const std::vector<double>& plusFour) const {
+        if(containsExponent(board, 11)) {
+            return 0.0;
+        }
+        double best = 0.0;
+        for(size_t m=0; m<4; ++m) {
+            uint32_t score;
+            uint64_t afterstate = rules.move(board, PLAYER_MOVES[m], score);
+            if(afterstate == board) {
+                continue;
+            }
+            uint64_t empty = rules.emptyCells(afterstate);
+            double expected = 0.0;
+            size_t numEmpty = __builtin_popcountll(empty);
+            for(; empty; empty &= empty - 1) {
+                unsigned shift = __builtin_ctzll(empty);
+                expected += 0.9 * plusTwo[layers[l + 1].indexOf(rules.canonical(afterstate | ((uint64_t)1 << shift)))]
+                    + 0.1 * plusFour[layers[l + 2].indexOf(rules.canonical(afterstate | ((uint64_t)2 << shift)))];
+            }
+            best = std::max(best, score + expected / numEmpty);
+        }
+        return best;
+    }
+public:
+    SmallBoardSolver(size_t width, size_t height, size_t numThreads) : rules(width, height), numThreads(std::max(numThreads, (size_t)1)), numStates(0) {}
+    const SmallBoardRules& getRules() const { return rules; }
+    /* the number of reachable canonical positions, once solve() has enumerated them */
+    size_t getNumStates() const { return numStates; }
+    /**
+     * Enumerates and solves every reachable position, and passes each
+     * layer with its values to the callback, from the highest tile sum
+     * down.  Returns the expected final score of a game with perfect
+     * play, over the start boards.
+     */
+    double solve(const LayerCallback& callback) {
+        enumerate();
+        auto starts = rules.startBoards();
+        double startTotal = 0.0;
+        std::vector<double> plusTwo;
+        std::vector<double> plusFour;
+        for(size_t l=layers.size()-2; l--; ) {
+            const Layer& layer = layers[l];
+            std::vector<double> values(layer.boards.size());
+            workerPool().run(numThreads, [&](size_t thread) {
+                size_t end = (thread + 1) * values.size() / numThreads;
+                for(size_t i=thread*values.size()/numThreads; i<end; ++i) {
+                    values[i] = valueOf(layer.boards[i], l, plusTwo, plusFour);
+                }
+            });
+            callback(layer, values);
+            for(auto board : starts) {
+                if(tileSum(board) / 2 == l) {
+                    startTotal += values[layer.indexOf(rules.canonical(board))];
+                }
+            }
+            std::vector<uint64_t>().swap(layers[l + 2].boards);
+            plusFour.swap(plusTwo);
+            plusTwo.swap(values);
+        }
+        layers.clear();
+        return startTotal / starts.size();
+    }
+};
+
+const unsigned SmallBoardSolver::BUCKET_BITS;
+const size_t SmallBoardSolver::NUM_BUCKETS;
+
+/**
+ * A set of boards that many threads insert into at once without locks:
+ * open addressing with linear probing, where a thread claims an empty
+ * slot with a compare-and-swap.  The capacity is fixed, so it must be
+ * chosen with room to spare.  An empty slot holds 0, which is no
+ * position's board.
+ */
+class ConcurrentBoardSet {
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    unsigned bits;
+public:
+    /* a power of two, with at least a third of minCapacity left empty */
+    explicit ConcurrentBoardSet(size_t minCapacity) : bits(10) {
+        while(((size_t)1 << bits) < minCapacity + minCapacity / 2) {
+            ++bits;
+        }
+        slots.reset(new std::atomic<uint64_t>[capacity()]);
+        for(size_t i=0; i<capacity(); ++i) {
+            slots[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    size_t capacity() const {
+        return (size_t)1 << bits;
+    }
+    /* whether the board was new to the set */
+    inline bool insert(uint64_t board) {
+        size_t index = (board * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+        for(;;) {
+            uint64_t current = slots[index].load(std::memory_order_relaxed);
+            if(current == board) {
+                return false;
+            } else if(current == 0) {
+                if(slots[index].compare_exchange_strong(current, board, std::memory_order_relaxed)) {
+                    return true;
+                } else if(current == board) {
+                    return false;
+                }
+            }
+            index = (index + 1) & (capacity() - 1);
+        }
+    }
+    /* the board in a slot, or 0 */
+    inline uint64_t at(size_t index) const {
+        return slots[index].load(std::memory_order_relaxed);
+    }
+};
+
+struct ExploredPly {
+    size_t   ply;
+    /* distinct positions (afterstates on odd plies), up to symmetry if asked */
+    uint64_t positions;
+    /* moves or spawns that lead to them from the ply before */
+    uint64_t edges;
+    /* the set and the two frontiers while the ply was expanded */
+    size_t   bytes;
+};
+
+/**
+ * Counts the distinct positions reachable from a board, a ply at a
+ * time: the odd plies are the afterstates of the player's moves and
+ * the even ones the positions after the spawns.  Each ply's positions
+ * are deduplicated in a ConcurrentBoardSet, which the threads of the
+ * WorkerPool fill in parallel, and are the frontier of the next ply.
+ * A perft-style count of the Node tree would count every path to a
+ * position; the ratio of edges to positions is how often a
+ * transposition table would find a position again.  With symmetric,
+ * positions are counted once per class of the board's symmetries
+ * (SmallBoardRules::canonical()).  As in the search, 2048 ends the
+ * game.  Calls onPly after each ply, and stops after plies plies or
+ * when nothing is left.
+ */
+void exploreStates(uint64_t board, size_t plies, size_t numThreads, bool symmetric, const std::function<void(const ExploredPly&)>& onPly) {
+    const MoveTables& tables = getMoveTables();
+    const SmallBoardRules rules(4, 4);
+    numThreads = std::max(numThreads, (size_t)1);
+    std::vector<uint64_t> frontier(1, symmetric ? rules.canonical(board) : board);
+    for(size_t ply=1; ply<=plies && !frontier.empty(); ++ply) {
+        bool moves = ply % 2 == 1;
+        /* at most four moves per position, and two spawns per empty cell */
+        size_t maxEdges = 0;
+        for(auto position : frontier) {
+            maxEdges += moves ? 4 : 2 * __builtin_popcountll(emptyCellMask(position));
+        }
+        ConcurrentBoardSet set(maxEdges);
+        std::vector<uint64_t> edges(numThreads, 0);
+        std::vector<uint64_t> inserted(numThreads, 0);
+        workerPool().run(numThreads, [&](size_t thread) {
+            auto insert = [&](uint64_t child) {
+                ++edges[thread];
+                inserted[thread] += set.insert(symmetric ? rules.canonical(child) : child);
+            };
+            size_t end = (thread + 1) * frontier.size() / numThreads;
+            for(size_t i=thread*frontier.size()/numThreads; i<end; ++i) {
+                uint64_t position = frontier[i];
+                if(moves) {
+                    if(containsExponent(position, 11)) {
+                        continue;
+                    }
+                    for(size_t m=0; m<4; ++m) {
+                        uint32_t score;
+                        uint64_t afterstate = applyMove(tables, position, PLAYER_MOVES[m], score);
+                        if(afterstate != position) {
+                            insert(afterstate);
+                        }
+                    }
+                } else {
+                    for(uint64_t empty = emptyCellMask(position); empty; empty &= empty - 1) {
+                        for(uint64_t tile : {1, 2}) {
+                            insert(position | (tile << __builtin_ctzll(empty)));
+                        }
+                    }
+                }
+            }
+        });
+        ExploredPly explored = { ply, 0, 0, 0 };
+        for(size_t t=0; t<numThreads; ++t) {
+            explored.positions += inserted[t];
+            explored.edges += edges[t];
+        }
+        /* the next frontier, gathered from slices of the set */
+        std::vector<std::vector<uint64_t>> slices(numThreads);
+        workerPool().run(numThreads, [&](size_t thread) {
+            size_t end = (thread + 1) * set.capacity() / numThreads;
+            for(size_t i=thread*set.capacity()/numThreads; i<end; ++i) {
+                if(set.at(i)) {
+                    slices[thread].push_back(set.at(i));
+                }
+            }
+        });
+        std::vector<uint64_t> next;
+        next.reserve(explored.positions);
+        for(auto& slice : slices) {
+            next.insert(next.end(), slice.begin(), slice.end());
+        }
+        explored.bytes = (set.capacity() + frontier.size() + next.size()) * sizeof(uint64_t);
+        frontier.swap(next);
+        onPly(explored);
+    }
+}
+
+/**
+ * Running count, mean and variance using Welford's online algorithm.
+ * Two instances can be merged (Chan et al.'s parallel update), so
+ * each thread or shard can keep its own and combine them at the end.
+ */
+class RunningStatistics {
+private:
+    uint64_t n;
+    double mean;
+    double m2;
+    double minimum;
+    double maximum;
+public:
+    RunningStatistics() : n(0), mean(0.0), m2(0.0), minimum(0.0), maximum(0.0) {}
+    void add(double x) {
+        if(unlikely(n == 0)) {
+            minimum = maximum = x;
+        } else {
+            minimum = std::min(minimum, x);
+            maximum = std::max(maximum, x);
+        }
+        ++n;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+    void merge(const RunningStatistics& other) {
+        if(other.n == 0) {
+            return;
+        } else if(n == 0) {
+            *this = other;
+            return;
+        }
+        uint64_t total = n + other.n;
+        double delta = other.mean - mean;
+        mean += delta * other.n / total;
+        m2 += other.m2 + delta * delta * ((double)n * other.n / total);
+        n = total;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+    }
+    uint64_t count() const { return n; }
+    double getMean() const { return mean; }
+    double getVariance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+    double getStandardDeviation() const { return std::sqrt(getVariance()); }
+    double getMin() const { return minimum; }
+    double getMax() const { return maximum; }
+};
+
+/**
+ * A fixed-size quantile sketch over non-negative integers.  Values
+ * are counted in logarithmically spaced buckets (as in DDSketch), so
+ * any reported quantile is within about 1% of a true sample value
+ * and the memory footprint does not depend on the number of samples.
+ * Merging is just adding bucket counts.
+ */
+class QuantileSketch {
+private:
+    /* gamma = (1 + alpha) / (1 - alpha) for a relative accuracy alpha of 1% */
+    static constexpr double GAMMA = 1.0202020202020203;
+    /* enough buckets to cover values up to 2^40 */
+    static constexpr size_t NUM_BUCKETS = 1388;
+    std::array<uint64_t,NUM_BUCKETS> buckets;
+    uint64_t zeroCount;
+    uint64_t total;
+    static size_t bucketFor(uint64_t value) {
+        size_t index = (size_t)std::ceil(std::log((double)value) / std::log(GAMMA));
+        return std::min(index, NUM_BUCKETS - 1);
+    }
+public:
+    QuantileSketch() : zeroCount(0), total(0) {
+        buckets.fill(0);
+    }
+    void add(uint64_t value) {
+        ++total;
+        if(value == 0) {
+            ++zeroCount;
+        } else {
+            ++buckets[bucketFor(value)];
+        }
+    }
+    void merge(const QuantileSketch& other) {
+        for(size_t i=0; i<NUM_BUCKETS; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        zeroCount += other.zeroCount;
+        total += other.total;
+    }
+    uint64_t count() const { return total; }
+    /* q is in [0, 1] */
+    double quantile(double q) const {
+        if(total == 0) {
+            return 0.0;
+        }
+        uint64_t rank = (uint64_t)(q * (total - 1));
+        if(rank < zeroCount) {
+            return 0.0;
+        }
+        uint64_t seen = zeroCount;
+        for(size_t i=0; i<NUM_BUCKETS; ++i) {
+            seen += buckets[i];
+            if(seen > rank) {
+                return 2.0 * std::pow(GAMMA, (double)i) / (GAMMA + 1.0);
+            }
+        }
+        return 2.0 * std::pow(GAMMA, (double)(NUM_BUCKETS - 1)) / (GAMMA + 1.0);
+    }
+};
+
+/**
+ * Aggregate results of a batch of games in constant memory.  Each
+ * worker thread keeps its own instance and merges it into the total.
+ */
+class GameStatistics {
+private:
+    RunningStatistics scores;
+    RunningStatistics moves;
+    QuantileSketch scoreQuantiles;
+    QuantileSketch moveQuantiles;
+    /* indexed by the exponent of the largest tile */
+    std::array<uint64_t,16> maxTileCounts;
+    uint64_t totalMoves;
+    /* by the searches that chose the moves (zero for the batched simulator) */
+    uint64_t searchedNodes;
+    LeafCacheCounts leafCache;
+    /* wall-clock time spent playing; workers (and shards) are assumed to run concurrently */
+    double elapsedSeconds;
+public:
+    GameStatistics() : totalMoves(0), searchedNodes(0), leafCache({ 0, 0 }), elapsedSeconds(0.0) {
+        maxTileCounts.fill(0);
+    }
+    void addGame(uint64_t score, uint64_t numMoves, uint_fast8_t largestExponent) {
+        scores.add((double)score);
+        moves.add((double)numMoves);
+        scoreQuantiles.add(score);
+        moveQuantiles.add(numMoves);
+        ++maxTileCounts[largestExponent & 0b1111];
+        totalMoves += numMoves;
+    }
+    void addSearchedNodes(uint64_t nodes) {
+        searchedNodes += nodes;
+    }
+    void addLeafCacheCounts(const LeafCacheCounts& counts) {
+        leafCache.probes += counts.probes;
+        leafCache.hits += counts.hits;
+    }
+    void addElapsedTime(double seconds) {
+        elapsedSeconds += seconds;
+    }
+    void merge(const GameStatistics& other) {
+        scores.merge(other.scores);
+        moves.merge(other.moves);
+        scoreQuantiles.merge(other.scoreQuantiles);
+        moveQuantiles.merge(other.moveQuantiles);
+        for(size_t i=0; i<maxTileCounts.size(); ++i) {
+            maxTileCounts[i] += other.maxTileCounts[i];
+        }
+        totalMoves += other.totalMoves;
+        searchedNodes += other.searchedNodes;
+        addLeafCacheCounts(other.leafCache);
+        elapsedSeconds = std::max(elapsedSeconds, other.elapsedSeconds);
+    }
+    uint64_t numGames() const { return scores.count(); }
+    double movesPerSecond() const {
+        return elapsedSeconds > 0.0 ? totalMoves / elapsedSeconds : 0.0;
+    }
+    void report(std::ostream& stream) const {
+        stream << "Games: " << numGames() << std::endl;
+        if(numGames() == 0) {
+            return;
+        }
+        for(auto& s : {std::make_tuple("Score", &scores, &scoreQuantiles), std::make_tuple("Moves", &moves, &moveQuantiles)}) {
+            auto running = std::get<1>(s);
+            auto sketch = std::get<2>(s);
+            stream << std::get<0>(s) << ": mean " << running->getMean() << ", stddev " << running->getStandardDeviation() << ", min " << running->getMin() << ", max " << running->getMax() << std::endl;
+            stream << "\t";
+            for(auto q : {0.1, 0.25, 0.5, 0.75, 0.9, 0.99}) {
+                stream << " p" << (int)(q * 100 + 0.5) << "=" << (uint64_t)(sketch->quantile(q) + 0.5);
+            }
+            stream << std::endl;
+        }
+        stream << "Largest tile:" << std::endl;
+        for(size_t i=0; i<maxTileCounts.size(); ++i) {
+            if(maxTileCounts[i]) {
+                stream << "\t" << (i ? (2 << (i - 1)) : 0) << ": " << maxTileCounts[i] << " (" << (100.0 * maxTileCounts[i] / numGames()) << "%)" << std::endl;
+            }
+        }
+        stream << "Moves/second: " << movesPerSecond() << std::endl;
+        if(searchedNodes && elapsedSeconds > 0.0) {
+            stream << "Nodes/second: " << searchedNodes / elapsedSeconds << std::endl;
+        }
+        if(leafCache.probes) {
+            stream << "Leaf cache: " << leafCache.probes << " probes, " << (100.0 * leafCache.hits / leafCache.probes) << "% hits" << std::endl;
+        }
+    }
+};
+
+/**
+ * One training sample: the afterstate produced by the player's move
+ * (the RANDOM node from getSuccessors()) together with the search
+ * result that chose it and the eventual outcome of the game.  Records
+ * have a fixed size and native byte order so that a shard can be
+ * mmapped as an array and shuffled in place.
+ */
+struct TrainingSample {
+    uint64_t afterstate;
+    int64_t  searchValue;
+    /* score of the game at the afterstate and at the end of the game */
+    uint32_t score;
+    uint32_t finalScore;
+    uint16_t searchDepth;
+    uint8_t  move;
+    uint8_t  reserved[5];
+};
+static_assert(sizeof(TrainingSample) == 32, "training samples must have a fixed record size");
+
+/**
+ * Writes the samples of a training data shard as CSV, one line per
+ * sample with the record's fields and the FeatureVector of its
+ * afterstate, for tuning tools that work on features rather than
+ * boards.
+ */
+bool exportFeatures(const char* path, std::ostream& stream) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        std::cerr << "Could not open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    stream << "afterstate,search_value,score,final_score,search_depth,move";
+    for(auto name : FeatureVector::NAMES) {
+        stream << "," << name;
+    }
+    stream << std::endl;
+    TrainingSample sample;
+    while(fread(&sample, sizeof(sample), 1, file) == 1) {
+        stream << "0x" << std::hex << std::setw(16) << std::setfill('0') << sample.afterstate << std::dec << std::setfill(' ');
+        stream << "," << sample.searchValue << "," << sample.score << "," << sample.finalScore << "," << sample.searchDepth << "," << (unsigned)sample.move;
+        for(auto value : Board(sample.afterstate).getFeatures().values) {
+            stream << "," << (unsigned)value;
+        }
+        stream << std::endl;
+    }
+    bool ok = !ferror(file);
+    if(!ok) {
+        std::cerr << "Could not read " << path << std::endl;
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Appends training samples to numShards files named
+ * PREFIX.NNN.bin.  Games are handed over whole and written by a
+ * background thread, so the play loop only pays for a queue push.  If
+ * the writer falls more than MAX_QUEUED_SAMPLES behind, producers
+ * block until it catches up.  A failed write is reported once and
+ * makes sync() and close() fail, so samples are never lost silently.
+ */
+class TrainingDataWriter {
+private:
+    static const size_t MAX_QUEUED_SAMPLES = 1 << 20;
+    std::vector<FILE*> shards;
+    std::deque<std::pair<size_t,std::vector<TrainingSample>>> queue;
+    size_t queuedSamples;
+    bool closing;
+    /* a write or close failed; sticky */
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::thread writerThread;
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            notEmpty.wait(lock, [this]() { return closing || !queue.empty(); });
+            if(queue.empty()) {
+                return;
+            }
+            auto game = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            bool written = fwrite(game.second.data(), sizeof(TrainingSample), game.second.size(), shards[game.first]) == game.second.size();
+            int error = errno;
+            lock.lock();
+            if(!written && !failed) {
+                std::cerr << "Error writing training data shard " << game.first << ": " << strerror(error) << std::endl;
+                failed = true;
+            }
+            queuedSamples -= game.second.size();
+            notFull.notify_all();
+        }
+    }
+public:
+    TrainingDataWriter(const std::string& prefix, size_t numShards) : queuedSamples(0), closing(false), failed(false) {
+        for(size_t i=0; i<std::max(numShards, (size_t)1); ++i) {
+            std::stringstream path;
+            path << prefix << "." << std::setw(3) << std::setfill('0') << i << ".bin";
+            FILE* file = fopen(path.str().c_str(), "ab");
+            if(!file) {
+                std::cerr << "Error opening " << path.str() << ": " << strerror(errno) << std::endl;
+            } else {
+                setvbuf(file, nullptr, _IOFBF, 1 << 20);
+            }
+            shards.push_back(file);
+        }
+        writerThread = std::thread(&TrainingDataWriter::run, this);
+    }
+    TrainingDataWriter(const TrainingDataWriter&) = delete;
+    ~TrainingDataWriter() {
+        close();
+    }
+    bool good() const {
+        for(FILE* file : shards) {
+            if(!file) {
+                return false;
+            }
+        }
+        return true;
+    }
+    /* writes out the queue and closes the files; false if any sample was lost */
+    bool close() {
+        if(!writerThread.joinable()) {
+            return !failed;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        notEmpty.notify_all();
+        writerThread.join();
+        for(size_t i=0; i<shards.size(); ++i) {
+            if(shards[i] && fclose(shards[i]) && !failed) {
+                std::cerr << "Error writing training data shard " << i << ": " << strerror(errno) << std::endl;
+                failed = true;
+            }
+            shards[i] = nullptr;
+        }
+        return !failed;
+    }
+    /* waits until every queued sample is in the files, and returns their sizes */
+    bool sync(std::vector<uint64_t>& sizes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return queuedSamples == 0; });
+        if(failed) {
+            return false;
+        }
+        sizes.clear();
+        for(FILE* file : shards) {
+            struct stat st;
+            if(fflush(file) || fstat(fileno(file), &st)) {
+                std::cerr << "Error writing training data: " << strerror(errno) << std::endl;
+                return false;
+            }
+            sizes.push_back((uint64_t)st.st_size);
+        }
+        return true;
+    }
+    /* cuts the files back to the sizes sync() returned, before anything is written */
+    bool truncate(const std::vector<uint64_t>& sizes) {
+        if(sizes.size() != shards.size()) {
+            std::cerr << "The checkpoint was written with " << sizes.size() << " training data shards, not " << shards.size() << std::endl;
+            return false;
+        }
+        for(size_t i=0; i<shards.size(); ++i) {
+            struct stat st;
+            if(fstat(fileno(shards[i]), &st) || (uint64_t)st.st_size < sizes[i] || ftruncate(fileno(shards[i]), (off_t)sizes[i])) {
+                std::cerr << "Training data shard " << i << " does not match the checkpoint" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    /* all samples of one game go to shard (key % numShards) */
+    void write(size_t key, std::vector<TrainingSample>&& samples) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return queuedSamples < MAX_QUEUED_SAMPLES; });
+        queuedSamples += samples.size();
+        queue.emplace_back(key % shards.size(), std::move(samples));
+        lock.unlock();
+        notEmpty.notify_one();
+    }
+};
+
+/* parses a Linux CPU or node list such as "0-3,8-11" */
+std::vector<int> parseIdList(const char* list) {
+    std::vector<int> ids;
+    for(const char* p = list; *p && *p != '\n';) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if(end == p) {
+            break;
+        }
+        long last = first;
+        if(*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for(long id = first; id <= last; ++id) {
+            ids.push_back((int)id);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return ids;
+}
+
+/* the first line of a small file such as those in /sys, or "" */
+std::string readFirstLine(const std::string& path) {
+    char line[4096] = "";
+    FILE* file = fopen(path.c_str(), "r");
+    if(file) {
+        if(!fgets(line, sizeof(line), file)) {
+            line[0] = '\0';
+        }
+        fclose(file);
+    }
+    return line;
+}
+
+struct NumaNode {
+    int id;
+    /* only the CPUs this process may run on */
+    std::vector<int> cpus;
+};
+
+/**
+ * The NUMA nodes of the machine, from /sys/devices/system/node.  Where
+ * that is missing (no NUMA support, or a restricted container) all of
+ * the CPUs are treated as node 0.
+ */
+std::vector<NumaNode> detectNumaNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    std::vector<NumaNode> nodes;
+    for(int id : parseIdList(readFirstLine("/sys/devices/system/node/online").c_str())) {
+        NumaNode node = { id, {} };
+        std::stringstream path;
+        path << "/sys/devices/system/node/node" << id << "/cpulist";
+        for(int cpu : parseIdList(readFirstLine(path.str()).c_str())) {
+            if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        if(!node.cpus.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    if(nodes.empty()) {
+        NumaNode node = { 0, {} };
+        for(int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+            if(CPU_ISSET(cpu, &allowed)) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+#ifndef MPOL_BIND
+/* from <numaif.h>, which is only there with libnuma's headers */
+#define MPOL_BIND 2
+#define MPOL_INTERLEAVE 3
+#endif
+
+/**
+ * Page-aligned anonymous memory whose pages go to the given NUMA node,
+ * or are interleaved over the given nodes if there are several.  If the
+ * kernel has no mbind() (or refuses it) this is ordinary memory.
+ */
+void* allocateOnNodes(size_t bytes, const std::vector<int>& nodeIds) {
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#ifdef SYS_mbind
+    const size_t bitsPerWord = 8 * sizeof(unsigned long);
+    unsigned long mask[1024 / bitsPerWord] = {};
+    for(int id : nodeIds) {
+        if(id >= 0 && id < 1024) {
+            mask[id / bitsPerWord] |= 1UL << (id % bitsPerWord);
+        }
+    }
+    syscall(SYS_mbind, memory, bytes, nodeIds.size() > 1 ? MPOL_INTERLEAVE : MPOL_BIND, mask, (unsigned long)1024, 0);
+#endif
+    return memory;
+}
+
+/* how worker threads are pinned to CPUs */
+enum class WorkerPlacement : uint8_t {
+    NONE,
+    /* fill the CPUs of one node before moving on to the next */
+    COMPACT,
+    /* deal the workers out over the nodes in turn */
+    SPREAD
+};
+
+/* where the copies of the move and row weight tables that the workers read live */
+enum class TablePlacement : uint8_t {
+    SHARED,
+    REPLICATED,
+    INTERLEAVED
+};
+
+/**
+ * Places worker threads on a NUMA machine.  Each worker pins itself to
+ * a CPU when it starts, before it allocates anything, so that its own
+ * memory (e.g., a batch of the batched simulator) is first touched on
+ * its node.  The tables every search reads are either left shared,
+ * copied to every node with each worker reading its own node's copy, or
+ * copied once with the pages interleaved over all nodes.
+ */
+class NumaPlacement {
+private:
+    struct Tables {
+        const MoveTables* moveTables;
+        std::unique_ptr<RowWeightTable<float>>   floatTable;
+        std::unique_ptr<RowWeightTable<int16_t>> int16Table;
+        std::unique_ptr<RowWeightTable<int8_t>>  int8Table;
+    };
+    std::vector<NumaNode> nodes;
+    WorkerPlacement workerPlacement;
+    TablePlacement tablePlacement;
+    std::vector<std::pair<void*,size_t>> allocations;
+    /* one per node if REPLICATED, a single one if INTERLEAVED, none if SHARED */
+    std::vector<Tables> tables;
+    template<class T>
+    const T* copyToNodes(const T* source, size_t count, const std::vector<int>& nodeIds) {
+        void* memory = allocateOnNodes(count * sizeof(T), nodeIds);
+        allocations.emplace_back(memory, count * sizeof(T));
+        memcpy(memory, source, count * sizeof(T));
+        return (const T*)memory;
+    }
+    template<class Weight>
+    RowWeightTable<Weight>* copyToNodes(const RowWeightTable<Weight>* table, const std::vector<int>& nodeIds) {
+        if(!table) {
+            return nullptr;
+        }
+        return new RowWeightTable<Weight>(copyToNodes(table->getWeights(), NUM_ROW_WEIGHTS, nodeIds), table->getScale(), table->getOffset());
+    }
+    void addTables(const SearchOptions& options, const std::vector<int>& nodeIds) {
+        tables.emplace_back();
+        tables.back().moveTables = copyToNodes(&getMoveTables(), 1, nodeIds);
+        tables.back().floatTable.reset(copyToNodes(options.floatTable, nodeIds));
+        tables.back().int16Table.reset(copyToNodes(options.int16Table, nodeIds));
+        tables.back().int8Table.reset(copyToNodes(options.int8Table, nodeIds));
+    }
+public:
+    /* options gives the row weight tables to copy */
+    NumaPlacement(WorkerPlacement workerPlacement, TablePlacement tablePlacement, const SearchOptions& options) : nodes(detectNumaNodes()), workerPlacement(workerPlacement), tablePlacement(tablePlacement) {
+        if(tablePlacement == TablePlacement::REPLICATED) {
+            for(auto& node : nodes) {
+                addTables(options, { node.id });
+            }
+        } else if(tablePlacement == TablePlacement::INTERLEAVED) {
+            std::vector<int> nodeIds;
+            for(auto& node : nodes) {
+                nodeIds.push_back(node.id);
+            }
+            addTables(options, nodeIds);
+        }
+    }
+    NumaPlacement(const NumaPlacement&) = delete;
+    ~NumaPlacement() {
+        for(auto& allocation : allocations) {
+            munmap(allocation.first, allocation.second);
+        }
+    }
+    const std::vector<NumaNode>& getNodes() const { return nodes; }
+    /* the index (in getNodes()) of worker's node, and its CPU */
+    std::pair<size_t,int> locate(size_t worker) const {
+        if(workerPlacement == WorkerPlacement::COMPACT) {
+            size_t numCpus = 0;
+            for(auto& node : nodes) {
+                numCpus += node.cpus.size();
+            }
+            size_t k = worker % numCpus;
+            size_t n = 0;
+            for(; k >= nodes[n].cpus.size(); ++n) {
+                k -= nodes[n].cpus.size();
+            }
+            return std::make_pair(n, nodes[n].cpus[k]);
+        }
+        size_t n = worker % nodes.size();
+        return std::make_pair(n, nodes[n].cpus[(worker / nodes.size()) % nodes[n].cpus.size()]);
+    }
+    /**
+     * Called by each worker on its own thread as it starts: pins the
+     * thread and makes it read its node's tables.  Threads that the
+     * worker starts inherit its CPU mask, so if it runs parallel root
+     * searches it is pinned to its whole node rather than to one CPU.
+     * Returns options with the row weight tables the worker should use.
+     */
+    SearchOptions enter(size_t worker, const SearchOptions& options) const {
+        auto location = locate(worker);
+        if(workerPlacement != WorkerPlacement::NONE) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            if(options.rootThreads > 1 || options.multiPV) {
+                for(int cpu : nodes[location.first].cpus) {
+                    CPU_SET(cpu, &cpus);
+                }
+            } else {
+                CPU_SET(location.second, &cpus);
+            }
+            sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+        SearchOptions placed = options;
+        if(!tables.empty()) {
+            auto& local = tables[tablePlacement == TablePlacement::REPLICATED ? location.first : 0];
+            workerMoveTables = local.moveTables;
+            placed.floatTable = local.floatTable.get();
+            placed.int16Table = local.int16Table.get();
+            placed.int8Table = local.int8Table.get();
+        }
+        return placed;
+    }
+};
+
+/* set (before any games start) to place the headless and batched workers */
+const NumaPlacement* numaPlacement = nullptr;
+
+/* see NumaPlacement::enter() */
+SearchOptions enterWorker(size_t worker, const SearchOptions& options) {
+    return numaPlacement ? numaPlacement->enter(worker, options) : options;
+}
+
+/* serializes lines written to std::cout by concurrent headless games */
+std::mutex outputMutex;
+
+/**
+ * Lets the thread that runs a set of workers stop them at safe points
+ * (e.g., between two moves) to look at their state.  safePoint() is a
+ * relaxed atomic load unless a pause is pending.
+ */
+class WorkerPause {
+private:
+    std::atomic<bool> requested;
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t running;
+    size_t paused;
+public:
+    explicit WorkerPause(size_t numWorkers) : requested(false), running(numWorkers), paused(0) {}
+    WorkerPause(const WorkerPause&) = delete;
+    inline void safePoint() {
+        if(unlikely(requested.load(std::memory_order_relaxed))) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++paused;
+            changed.notify_all();
+            changed.wait(lock, [this]() { return !requested; });
+            --paused;
+            changed.notify_all();
+        }
+    }
+    /* called by each worker when it is done */
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        changed.notify_all();
+    }
+    /* makes coordinate() ask due() again */
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+    /**
+     * Runs on the coordinating thread until every worker has finished.
+     * due() is asked every pollInterval seconds and after each wake();
+     * whenever it returns true the workers are paused and onPause() is
+     * called.
+     */
+    template<class Due, class OnPause>
+    void coordinate(double pollInterval, const Due& due, const OnPause& onPause) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(running) {
+            if(!changed.wait_for(lock, std::chrono::duration<double>(pollInterval), [&]() { return running == 0 || due(); }) || !running) {
+                continue;
+            }
+            /* let the workers that were paused last time resume first */
+            changed.wait(lock, [this]() { return paused == 0; });
+            requested = true;
+            changed.wait(lock, [this]() { return paused == running; });
+            onPause();
+            requested = false;
+            changed.notify_all();
+        }
+    }
+};
+
+/**
+ * Takes the signals of a long run without running any code in signal
+ * context: block() blocks them in the calling thread and so in every
+ * thread it starts later, and a watcher thread takes them with
+ * sigwait().  SIGUSR1 asks for a progress report, SIGINT and SIGTERM
+ * for a graceful stop.  After the first stop they are unblocked in the
+ * watcher, so a second one kills the process as usual.
+ */
+class SignalWatcher {
+private:
+    std::atomic<uint64_t> reportRequests;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> closing;
+    std::mutex mutex;
+    std::function<void()> onSignal;
+    std::thread watcher;
+    static sigset_t signals(bool withStop) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        if(withStop) {
+            sigaddset(&set, SIGINT);
+            sigaddset(&set, SIGTERM);
+        }
+        return set;
+    }
+    void run() {
+        for(;;) {
+            sigset_t set = signals(!stopRequested);
+            int signal;
+            if(sigwait(&set, &signal) || closing) {
+                if(closing) {
+                    return;
+                }
+                continue;
+            }
+            if(signal == SIGUSR1) {
+                ++reportRequests;
+            } else {
+                stopRequested = true;
+                sigset_t stop = signals(true);
+                sigdelset(&stop, SIGUSR1);
+                /* (background jobs of a shell start with SIGINT ignored) */
+                ::signal(SIGINT, SIG_DFL);
+                ::signal(SIGTERM, SIG_DFL);
+                pthread_sigmask(SIG_UNBLOCK, &stop, nullptr);
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cerr << "Stopping after the games in progress; signal again to abort" << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if(onSignal) {
+                onSignal();
+            }
+        }
+    }
+public:
+    static void block() {
+        sigset_t set = signals(true);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    }
+    SignalWatcher() : reportRequests(0), stopRequested(false), closing(false) {
+        watcher = std::thread(&SignalWatcher::run, this);
+    }
+    SignalWatcher(const SignalWatcher&) = delete;
+    ~SignalWatcher() {
+        closing = true;
+        pthread_kill(watcher.native_handle(), SIGUSR1);
+        watcher.join();
+    }
+    uint64_t reports() const { return reportRequests; }
+    bool stopping() const { return stopRequested; }
+    /* f is called on the watcher thread after each signal */
+    void setOnSignal(const std::function<void()>& f) {
+        std::lock_guard<std::mutex> lock(mutex);
+        onSignal = f;
+    }
+};
+
+/* set for headless and batched runs in main() */
+SignalWatcher* signalWatcher = nullptr;
+
+inline bool stopRequested() {
+    return signalWatcher && signalWatcher->stopping();
+}
+
+/* prints the statistics of a run in progress (for SIGUSR1) and the memory use */
+void reportProgress(const GameStatistics& stats, size_t gamesInProgress, std::ostream& stream) {
+    unsigned long long pages = 0, residentPages = 0;
+    sscanf(readFirstLine("/proc/self/statm").c_str(), "%llu %llu", &pages, &residentPages);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::lock_guard<std::mutex> lock(outputMutex);
+    stream << "Progress:" << std::endl;
+    stats.report(stream);
+    stream << "Games in progress: " << gamesInProgress << std::endl;
+    stream << "Memory: " << (residentPages * sysconf(_SC_PAGESIZE) >> 20) << " MiB resident, " << (usage.ru_maxrss >> 10) << " MiB peak" << std::endl << std::endl;
+}
+
+/* binary I/O of plain values and vectors of them, for checkpoints */
+template<class T>
+bool writeValue(FILE* file, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written directly");
+    return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+template<class T>
+bool readValue(FILE* file, T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read directly");
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+template<class T>
+bool writeVector(FILE* file, const std::vector<T>& values) {
+    uint64_t size = values.size();
+    return writeValue(file, size) && fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+template<class T>
+bool readVector(FILE* file, std::vector<T>& values) {
+    uint64_t size;
+    if(!readValue(file, size)) {
+        return false;
+    }
+    values.resize(size);
+    return fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+/**
+ * A headless game after a spawn, with everything needed to continue it
+ * exactly: the position, the random engine that places the spawns and
+ * the training samples of the moves so far.
+ */
+struct HeadlessGame {
+    /* the game's number in its run, and its seed */
+    uint64_t index;
+    unsigned seed;
+    uint64_t board;
+    uint32_t score;
+    uint64_t numMoves;
+    Xoshiro256 rand;
+    std::vector<TrainingSample> samples;
+    HeadlessGame() : index(0), seed(0), board(0), score(0), numMoves(0) {}
+    HeadlessGame(uint64_t index, unsigned seed) : index(index), seed(seed), board(Node(seed).getBoard().getRawBoard()), score(0), numMoves(0), rand(seed) {}
+    bool write(FILE* file) const {
+        return writeValue(file, index) && writeValue(file, seed) && writeValue(file, board) && writeValue(file, score)
+            && writeValue(file, numMoves) && writeValue(file, rand) && writeVector(file, samples);
+    }
+    bool read(FILE* file) {
+        return readValue(file, index) && readValue(file, seed) && readValue(file, board) && readValue(file, score)
+            && readValue(file, numMoves) && readValue(file, rand) && readVector(file, samples);
+    }
+};
+
+const char CHECKPOINT_MAGIC[8] = { '2', '0', '4', '8', 'C', 'K', 'P', '4' };
+
+/**
+ * The progress of a headless run: which games are complete, their
+ * statistics, the games that were being played, and how long each
+ * training data shard was (everything past that belongs to games that
+ * were completed after the checkpoint, and will be played again).
+ *
+ * A checkpoint file is the 8-byte CHECKPOINT_MAGIC followed by the
+ * fields in order; it is written to a temporary file and renamed over
+ * the old checkpoint, so an interruption never leaves a partial one.
+ */
+struct HeadlessCheckpoint {
+    uint64_t numGames;
+    unsigned firstSeed;
+    /* wall-clock time of the run so far; stats.elapsedSeconds is not used */
+    double elapsedSeconds;
+    GameStatistics stats;
+    /* one flag per game of the run */
+    std::vector<uint8_t> completed;
+    std::vector<HeadlessGame> inFlight;
+    std::vector<uint64_t> shardSizes;
+    HeadlessCheckpoint() : numGames(0), firstSeed(0), elapsedSeconds(0.0) {}
+    bool save(const char* path) const {
+        std::stringstream tempPath;
+        tempPath << path << ".tmp." << getpid();
+        FILE* file = fopen(tempPath.str().c_str(), "wb");
+        if(!file) {
+            std::cerr << "Error opening " << tempPath.str() << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        bool ok = fwrite(CHECKPOINT_MAGIC, 1, sizeof(CHECKPOINT_MAGIC), file) == sizeof(CHECKPOINT_MAGIC)
+            && writeValue(file, numGames) && writeValue(file, firstSeed) && writeValue(file, elapsedSeconds)
+            && writeValue(file, stats) && writeVector(file, completed) && writeValue(file, (uint64_t)inFlight.size());
+        for(auto& game : inFlight) {
+            ok = ok && game.write(file);
+        }
+        ok = ok && writeVector(file, shardSizes) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = fclose(file) == 0 && ok;
+        if(!ok || rename(tempPath.str().c_str(), path)) {
+            std::cerr << "Error writing " << path << ": " << strerror(errno) << std::endl;
+            unlink(tempPath.str().c_str());
+            return false;
+        }
+        return true;
+    }
+    bool load(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if(!file) {
+            std::cerr << "Error opening " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        uint64_t numInFlight = 0;
+        bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+            && !memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic))
+            && readValue(file, numGames) && readValue(file, firstSeed) && readValue(file, elapsedSeconds)
+            && readValue(file, stats) && readVector(file, completed) && readValue(file, numInFlight)
+            && completed.size() == numGames && numInFlight <= numGames;
+        inFlight.resize(ok ? numInFlight : 0);
+        for(auto& game : inFlight) {
+            ok = ok && game.read(file) && game.index < numGames && !completed[game.index];
+        }
+        ok = ok && readVector(file, shardSizes);
+        fclose(file);
+        if(!ok) {
+            std::cerr << path << " is not a checkpoint file" << std::endl;
+        }
+        return ok;
+    }
+};
+
+/**
+ * Plays a headless game to the end without any user interface, using
+ * either a fixed search depth or (if searchDepth is zero) the deadline.
+ * betweenMoves is called after every spawn, when game holds the whole
+ * state of the game.  If trainingData is given, one sample per move is
+ * written to it once the game is over.
+ */
+void playHeadlessGame(HeadlessGame& game, size_t searchDepth, unsigned long deadlineInUs, const SearchOptions& options, GameStatistics& stats, TrainingDataWriter* trainingData = nullptr, const std::function<void()>& betweenMoves = []() {}) {
+    Node node(Move::START, Board(game.board), Player::HUMAN, (uint16_t)game.score);
+    while(!node.isGameOver()) {
+        if(node.getPlayer() == Player::HUMAN) {
+            size_t depthReached = searchDepth;
+            auto report = [&game, &options](size_t maxDepth, const AlphaBetaResult& result) {
+                if(options.multiPV) {
+                    std::stringstream line;
+                    line << "analysis seed " << game.seed << " move " << game.numMoves << " depth " << maxDepth << ": ";
+                    printMoveValues(line, result) << std::endl;
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    std::cout << line.str();
+                }
+            };
+            AlphaBetaResult suggestion;
+            if(searchDepth) {
+                suggestion = suggestMove(node, searchDepth, options);
+                report(searchDepth, suggestion);
+            } else {
+                suggestion = suggestMoveWithDeadline(node, deadlineInUs, [&depthReached,&report](size_t maxDepth, const AlphaBetaResult& result) {
+                        depthReached = maxDepth;
+                        report(maxDepth, result);
+                    }, options);
+            }
+            for(auto& succ : node.getSuccessors()) {
+                if(succ.getMove() == suggestion.move) {
+                    if(trainingData) {
+                        TrainingSample sample = {};
+                        sample.afterstate = succ.getBoard().getRawBoard();
+                        sample.searchValue = suggestion.value;
+                        sample.score = succ.getScore();
+                        sample.searchDepth = (uint16_t)depthReached;
+                        sample.move = (uint8_t)suggestion.move;
+                        game.samples.push_back(sample);
+                    }
+                    node = std::move(succ);
+                    break;
+                }
+            }
+            ++game.numMoves;
+            stats.addSearchedNodes(suggestion.searchedNodes);
+            stats.addLeafCacheCounts(takeLeafCacheCounts());
+        } else {
+            node = node.getRandomSuccessorForComputer(game.rand);
+            game.board = node.getBoard().getRawBoard();
+            game.score = node.getScore();
+            betweenMoves();
+        }
+    }
+    stats.addGame(node.getScore(), game.numMoves, node.getBoard().getLargestExponent());
+    if(trainingData) {
+        for(auto& sample : game.samples) {
+            sample.finalScore = node.getScore();
+        }
+        trainingData->write(game.seed, std::move(game.samples));
+    }
+}
+
+/**
+ * Plays numGames games (with seeds firstSeed, firstSeed + 1, ...)
+ * spread over numThreads worker threads and returns the merged
+ * statistics.  Normally a worker takes the next game whenever it is
+ * free; with options.deterministic worker t plays the games t,
+ * t + numThreads, ... so that the statistics (which are merged in worker
+ * order) come out the same on every run.
+ *
+ * If resume is given, the run continues from it: the games that were
+ * in flight are finished first, then the ones that were not started.
+ * If checkpointPath is given, every checkpointInterval seconds the
+ * workers are paused after their next spawn and the progress is written
+ * there, as it is once more at the end.  The same pause gives the
+ * progress reports for SIGUSR1; after SIGINT or SIGTERM no more games
+ * are started.
+ */
+GameStatistics runHeadless(size_t numGames, unsigned firstSeed, size_t numThreads, size_t searchDepth, unsigned long deadlineInUs, const SearchOptions& options, TrainingDataWriter* trainingData = nullptr, const HeadlessCheckpoint* resume = nullptr, const char* checkpointPath = nullptr, double checkpointInterval = 60.0) {
+    auto startTime = std::chrono::steady_clock::now();
+    size_t numWorkers = std::max(numThreads, (size_t)1);
+    HeadlessCheckpoint progress;
+    std::vector<HeadlessGame> resumed;
+    if(resume) {
+        progress = *resume;
+        resumed.swap(progress.inFlight);
+    } else {
+        progress.numGames = numGames;
+        progress.firstSeed = firstSeed;
+        progress.completed.assign(numGames, 0);
+    }
+    std::vector<uint8_t> started(progress.completed);
+    for(auto& game : resumed) {
+        started[game.index] = 1;
+    }
+    std::vector<uint64_t> notStarted;
+    for(uint64_t game=0; game<numGames; ++game) {
+        if(!started[game]) {
+            notStarted.push_back(game);
+        }
+    }
+    size_t numPending = resumed.size() + notStarted.size();
+
+    std::vector<GameStatistics> locals(numWorkers);
+    std::vector<HeadlessGame*> current(numWorkers, nullptr);
+    std::atomic<size_t> nextGame(0);
+    WorkerPause pause(numWorkers);
+    /* only called while every running worker is paused (or none is left) */
+    auto takeSnapshot = [&]() {
+        HeadlessCheckpoint snapshot;
+        snapshot.numGames = numGames;
+        snapshot.firstSeed = firstSeed;
+        snapshot.elapsedSeconds = progress.elapsedSeconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        snapshot.stats = progress.stats;
+        for(auto& local : locals) {
+            snapshot.stats.merge(local);
+        }
+        snapshot.completed = progress.completed;
+        for(auto game : current) {
+            if(game) {
+                snapshot.inFlight.push_back(*game);
+            }
+        }
+        return snapshot;
+    };
+    auto checkpoint = [&](HeadlessCheckpoint& snapshot) {
+        if(!trainingData || trainingData->sync(snapshot.shardSizes)) {
+            snapshot.save(checkpointPath);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t t=0; t<numWorkers; ++t) {
+        workers.emplace_back([&, t]() {
+                SearchOptions workerOptions = enterWorker(t, options);
+                for(size_t k = options.deterministic ? t : nextGame++; k < numPending && !stopRequested(); k = options.deterministic ? k + numWorkers : nextGame++) {
+                    HeadlessGame game = k < resumed.size() ? std::move(resumed[k]) : HeadlessGame(notStarted[k - resumed.size()], firstSeed + (unsigned)notStarted[k - resumed.size()]);
+                    current[t] = &game;
+                    playHeadlessGame(game, searchDepth, deadlineInUs, workerOptions, locals[t], trainingData, [&pause]() { pause.safePoint(); });
+                    progress.completed[game.index] = 1;
+                    current[t] = nullptr;
+                }
+                pause.finish();
+            });
+    }
+    auto nextCheckpoint = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(checkpointInterval));
+    uint64_t reportsDone = signalWatcher ? signalWatcher->reports() : 0;
+    if(signalWatcher) {
+        signalWatcher->setOnSignal([&pause]() { pause.wake(); });
+    }
+    pause.coordinate(checkpointPath ? std::min(checkpointInterval, 1.0) : 60.0, [&]() {
+            return (checkpointPath && std::chrono::steady_clock::now() >= nextCheckpoint) || (signalWatcher && signalWatcher->reports() != reportsDone);
+        }, [&]() {
+            auto snapshot = takeSnapshot();
+            if(checkpointPath && std::chrono::steady_clock::now() >= nextCheckpoint) {
+                checkpoint(snapshot);
+                nextCheckpoint = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(checkpointInterval));
+            }
+            if(signalWatcher && signalWatcher->reports() != reportsDone) {
+                reportsDone = signalWatcher->reports();
+                snapshot.stats.addElapsedTime(snapshot.elapsedSeconds);
+                reportProgress(snapshot.stats, snapshot.inFlight.size(), std::cerr);
+            }
+        });
+    if(signalWatcher) {
+        signalWatcher->setOnSignal(nullptr);
+    }
+    GameStatistics total = progress.stats;
+    for(size_t t=0; t<numWorkers; ++t) {
+        workers[t].join();
+        total.merge(locals[t]);
+    }
+    if(checkpointPath) {
+        auto snapshot = takeSnapshot();
+        checkpoint(snapshot);
+    }
+    total.addElapsedTime(progress.elapsedSeconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+    return total;
+}
+
+/**
+ * Cheap policies for the batched simulator.  Each one is handed the
+ * four afterstates of a game (in PLAYER_MOVES order), a bitmask of
+ * which of them are legal (never zero) and 64 random bits, and
+ * returns the index of the move to play.
+ */
+struct RandomBatchPolicy {
+    inline size_t operator()(const uint64_t*, uint_fast8_t legalMask, uint64_t random) const {
+        size_t k = (size_t)(((random & 0xFFFFFFFF) * __builtin_popcount(legalMask)) >> 32);
+        for(; k; --k) {
+            legalMask &= legalMask - 1;
+        }
+        return __builtin_ctz(legalMask);
+    }
+};
+
+/* plays the legal move that leaves the most empty cells */
+struct GreedyBatchPolicy {
+    inline size_t operator()(const uint64_t* afterstates, uint_fast8_t legalMask, uint64_t) const {
+        size_t best = __builtin_ctz(legalMask);
+        int bestEmpty = -1;
+        for(size_t i=0; i<4; ++i) {
+            int empty = __builtin_popcountll(emptyCellMask(afterstates[i]));
+            if((legalMask & (1 << i)) && empty > bestEmpty) {
+                best = i;
+                bestEmpty = empty;
+            }
+        }
+        return best;
+    }
+};
+
+/* plays the legal move whose afterstate the row weight table likes best */
+template<class Weight>
+struct TableBatchPolicy {
+    const RowWeightTable<Weight>* table;
+    TableBatchPolicy(const RowWeightTable<Weight>* table) : table(table) {}
+    inline size_t operator()(const uint64_t* afterstates, uint_fast8_t legalMask, uint64_t) const {
+        size_t best = __builtin_ctz(legalMask);
+        int_fast64_t bestValue = std::numeric_limits<int_fast64_t>::min();
+        for(size_t i=0; i<4; ++i) {
+            if(legalMask & (1 << i)) {
+                auto value = table->evaluate(afterstates[i]);
+                if(value > bestValue) {
+                    best = i;
+                    bestValue = value;
+                }
+            }
+        }
+        return best;
+    }
+};
+
+/**
+ * Advances many games in lockstep.  The games are stored as a
+ * structure of arrays (lane i of every vector belongs to the same
+ * game) and each step runs a sequence of tight passes over all lanes:
+ * expand the four moves from the row tables, retire finished games
+ * by compacting the arrays, apply each game's chosen move, and spawn
+ * a random tile.  The rules match Node: the game ends when there is
+ * no legal move or a 2048 appears, and spawns are a 2 with
+ * probability 0.9 (otherwise a 4) in a uniformly random empty cell,
+ * just like getRandomSuccessorForComputer().
+ */
+template<class Policy>
+class BatchedSelfPlay {
+private:
+    const MoveTables& tables;
+    Policy policy;
+    Xoshiro256 rand;
+    std::vector<uint64_t> boards;
+    std::vector<uint32_t> scores;
+    std::vector<uint32_t> numMoves;
+    /* four per lane, in PLAYER_MOVES order */
+    std::vector<uint64_t> afterstates;
+    std::vector<uint32_t> moveScores;
+    std::vector<uint8_t> legalMasks;
+public:
+    BatchedSelfPlay(const Xoshiro256& rand, const Policy& policy = Policy()) : tables(getMoveTables()), policy(policy), rand(rand) {}
+    size_t size() const { return boards.size(); }
+    void addGame(uint64_t board) {
+        boards.push_back(board);
+        scores.push_back(0);
+        numMoves.push_back(0);
+    }
+    /**
+     * Plays one move (and the following spawn) in every game.  Games
+     * that are over are first passed to onFinished(board, score,
+     * numMoves) and removed.
+     */
+    template<class FinishedCallback>
+    void step(const FinishedCallback& onFinished) {
+        size_t n = boards.size();
+        afterstates.resize(4 * n);
+        moveScores.resize(4 * n);
+        legalMasks.resize(n);
+
+        /* expand */
+        for(size_t i=0; i<n; ++i) {
+            uint_fast8_t legal = 0;
+            for(size_t m=0; m<4; ++m) {
+                afterstates[4*i + m] = applyMove(tables, boards[i], PLAYER_MOVES[m], moveScores[4*i + m]);
+                legal |= (afterstates[4*i + m] != boards[i]) << m;
+            }
+            legalMasks[i] = containsExponent(boards[i], 11) ? 0 : legal;
+        }
+
+        /* compact out the finished games, preserving lane order */
+        size_t out = 0;
+        for(size_t i=0; i<n; ++i) {
+            if(unlikely(!legalMasks[i])) {
+                onFinished(boards[i], scores[i], numMoves[i]);
+                continue;
+            }
+            if(out != i) {
+                boards[out] = boards[i];
+                scores[out] = scores[i];
+                numMoves[out] = numMoves[i];
+                legalMasks[out] = legalMasks[i];
+                for(size_t m=0; m<4; ++m) {
+                    afterstates[4*out + m] = afterstates[4*i + m];
+                    moveScores[4*out + m] = moveScores[4*i + m];
+                }
+            }
+            ++out;
+        }
+        n = out;
+        boards.resize(n);
+        scores.resize(n);
+        numMoves.resize(n);
+
+        /* choose and apply the moves */
+        for(size_t i=0; i<n; ++i) {
+            size_t m = policy(&afterstates[4*i], legalMasks[i], rand());
+            boards[i] = afterstates[4*i + m];
+            scores[i] += moveScores[4*i + m];
+            ++numMoves[i];
+        }
+
+        /* spawn; a legal move always leaves at least one empty cell */
+        for(size_t i=0; i<n; ++i) {
+            uint64_t empty = emptyCellMask(boards[i]);
+            for(uint32_t k = rand.below(__builtin_popcountll(empty)); k; --k) {
+                empty &= empty - 1;
+            }
+            uint64_t tile = rand.below(10) ? 1 : 2;
+            boards[i] |= tile << __builtin_ctzll(empty);
+        }
+    }
+};
+
+/**
+ * Plays numGames games with the batched simulator, keeping up to
+ * batchWidth games in flight per thread.  Game i starts from the same
+ * position as Node(firstSeed + i).  Each thread draws the spawns from
+ * its own random stream, so a game's outcome depends on the thread that
+ * plays it; with deterministic set thread t plays the games t,
+ * t + numThreads, ... and the statistics are the same on every run.
+ * Like runHeadless(), reports progress on SIGUSR1 and stops starting
+ * games after SIGINT or SIGTERM.
+ */
+template<class Policy>
+GameStatistics runBatched(size_t numGames, unsigned firstSeed, size_t numThreads, size_t batchWidth, const Policy& policy = Policy(), bool deterministic = false) {
+    auto startTime = std::chrono::steady_clock::now();
+    size_t numWorkers = std::max(numThreads, (size_t)1);
+    std::vector<GameStatistics> locals(numWorkers);
+    std::vector<size_t> inFlight(numWorkers, 0);
+    std::atomic<size_t> nextGame(0);
+    WorkerPause pause(numWorkers);
+    std::vector<std::thread> workers;
+    for(size_t t=0; t<numWorkers; ++t) {
+        workers.emplace_back([&,t]() {
+                enterWorker(t, SearchOptions());
+                GameStatistics& local = locals[t];
+                size_t nextOwnGame = t;
+                auto startTime = std::chrono::steady_clock::now();
+                BatchedSelfPlay<Policy> batch(Xoshiro256::stream(firstSeed, t), policy);
+                auto onFinished = [&local](uint64_t board, uint32_t score, uint32_t moves) {
+                    local.addGame(score, moves, Board(board).getLargestExponent());
+                };
+                for(;;) {
+                    for(size_t game; batch.size() < batchWidth && !stopRequested() && (game = deterministic ? nextOwnGame : nextGame++) < numGames;) {
+                        batch.addGame(Node(firstSeed + (unsigned)game).getBoard().getRawBoard());
+                        nextOwnGame += numWorkers;
+                    }
+                    if(!batch.size()) {
+                        break;
+                    }
+                    batch.step(onFinished);
+                    inFlight[t] = batch.size();
+                    pause.safePoint();
+                }
+                local.addElapsedTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+                pause.finish();
+            });
+    }
+    uint64_t reportsDone = signalWatcher ? signalWatcher->reports() : 0;
+    if(signalWatcher) {
+        signalWatcher->setOnSignal([&pause]() { pause.wake(); });
+    }
+    pause.coordinate(60.0, [&]() { return signalWatcher && signalWatcher->reports() != reportsDone; }, [&]() {
+            reportsDone = signalWatcher->reports();
+            GameStatistics snapshot;
+            size_t gamesInProgress = 0;
+            for(size_t t=0; t<numWorkers; ++t) {
+                snapshot.merge(locals[t]);
+                gamesInProgress += inFlight[t];
+            }
+            snapshot.addElapsedTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+            reportProgress(snapshot, gamesInProgress, std::cerr);
+        });
+    if(signalWatcher) {
+        signalWatcher->setOnSignal(nullptr);
+    }
+    GameStatistics total;
+    for(size_t t=0; t<numWorkers; ++t) {
+        workers[t].join();
+        total.merge(locals[t]);
+    }
+    return total;
+}
+
+/**
+ * Checks Board::getFeatures() against the separate feature functions,
+ * and every BitplaneBoard query against the packed board and Board, on
+ * the positions of numGames random games.  Returns the number of
+ * mismatches.
+ */
+size_t validateBoardQueries(size_t numGames, unsigned firstSeed) {
+    const MoveTables& tables = getMoveTables();
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        for(;;) {
+            uint64_t board = node.getBoard().getRawBoard();
+            Board packed(board);
+            BitplaneBoard planes(board);
+            uint_fast8_t legal = 0;
+            for(size_t m=0; m<4; ++m) {
+                uint32_t score;
+                legal |= (applyMove(tables, board, PLAYER_MOVES[m], score) != board) << m;
+            }
+            mismatches += packed.getFeatures() != packed.getFeaturesSeparately();
+            mismatches += planes.getRawBoard() != board;
+            mismatches += planes.numEmptySpaces() != packed.numEmptySpaces();
+            mismatches += planes.getLargestExponent() != packed.getLargestExponent();
+            mismatches += planes.legalMoves() != legal;
+            mismatches += planes.isGameOver() != !legal;
+            mismatches += planes.getSmoothness() != packed.getSmoothness();
+            mismatches += planes.getHeuristicOld(node.getScore(), !legal) != packed.getHeuristicOld(node.getScore(), !legal);
+            if(node.isGameOver()) {
+                break;
+            } else if(node.getPlayer() == Player::HUMAN) {
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Plays numGames random games through Node and checks that the row
+ * tables produce exactly the same successors: the same afterstate and
+ * score for every legal move, and the same empty cells (in the same
+ * order) for the spawns.  Returns the number of mismatches.
+ */
+size_t validateMoveTables(size_t numGames, unsigned firstSeed) {
+    const MoveTables& tables = getMoveTables();
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            uint64_t board = node.getBoard().getRawBoard();
+            auto& successors = node.getSuccessors();
+            if(node.getPlayer() == Player::HUMAN) {
+                uint_fast8_t legal = 0;
+                for(size_t m=0; m<4; ++m) {
+                    uint32_t score;
+                    uint64_t after = applyMove(tables, board, PLAYER_MOVES[m], score);
+                    bool found = false;
+                    for(auto& succ : successors) {
+                        if(succ.getMove() == PLAYER_MOVES[m]) {
+                            found = true;
+                            if(succ.getBoard().getRawBoard() != after || (uint32_t)(succ.getScore() - node.getScore()) != score) {
+                                ++mismatches;
+                            }
+                        }
+                    }
+                    if(found != (after != board)) {
+                        ++mismatches;
+                    }
+                    legal += found;
+                }
+                auto iter = successors.begin();
+                std::advance(iter, rand.below(legal));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                uint64_t empty = emptyCellMask(board);
+                auto iter = successors.begin();
+                for(; empty; empty &= empty - 1) {
+                    for(uint64_t tile : {1, 2}) {
+                        if(iter == successors.end() || iter->getBoard().getRawBoard() != (board | (tile << __builtin_ctzll(empty)))) {
+                            ++mismatches;
+                        } else {
+                            ++iter;
+                        }
+                    }
+                }
+                if(iter != successors.end()) {
+                    ++mismatches;
+                }
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+        if(containsExponent(node.getBoard().getRawBoard(), 11) != node.has2048()) {
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Checks ChanceAverage against 128-bit arithmetic on numCases random
+ * sets of values, from a few bits up to the full range of
+ * int_fast64_t.  Returns the number of mismatches.
+ */
+size_t validateChanceAverages(size_t numCases, unsigned seed) {
+    Xoshiro256 rand(seed);
+    size_t mismatches = 0;
+    for(size_t c=0; c<numCases; ++c) {
+        ChanceAverage average;
+        __int128 sum = 0;
+        int_fast64_t totalWeight = 0;
+        size_t numValues = rand.below(33);
+        unsigned bits = 1 + rand.below(64);
+        for(size_t i=0; i<numValues; ++i) {
+            int_fast64_t value = (int_fast64_t)rand() >> (64 - bits);
+            int_fast64_t weight = rand.below(2) ? ChanceAverage::TWO_WEIGHT : ChanceAverage::FOUR_WEIGHT;
+            average.add(value, weight);
+            sum += (__int128)value * weight;
+            totalWeight += weight;
+        }
+        int_fast64_t expected = 0;
+        if(totalWeight) {
+            auto numerator = 2 * sum + totalWeight;
+            auto divisor = 2 * totalWeight;
+            expected = (int_fast64_t)(numerator / divisor - (numerator % divisor < 0));
+        }
+        mismatches += average.rounded() != expected;
+    }
+    return mismatches;
+}
+
+/**
+ * Plain minimax or expectimax to remainingDepth over packed boards,
+ * with no windows and no pruning: the reference the search is checked
+ * against.  isChance tells whether the spawn is to move.
+ */
+template<class Evaluator>
+int_fast64_t referenceSearch(const Evaluator& evaluate, ChanceModel model, uint64_t board, uint32_t score, size_t remainingDepth, bool isChance) {
+    if(isChance) {
+        bool has2048 = containsExponent(board, 11);
+        if(!remainingDepth || has2048) {
+            return evaluate(board, score, has2048);
+        }
+        ChanceAverage average;
+        int_fast64_t worst = std::numeric_limits<int_fast64_t>::max();
+        for(uint64_t empty = emptyCellMask(board); empty; empty &= empty - 1) {
+            for(uint64_t tile : {1, 2}) {
+                int_fast64_t value = referenceSearch(evaluate, model, board | (tile << __builtin_ctzll(empty)), score, remainingDepth - 1, false);
+                average.add(value, tile == 1 ? ChanceAverage::TWO_WEIGHT : ChanceAverage::FOUR_WEIGHT);
+                worst = std::min(worst, value);
+            }
+        }
+        return model == ChanceModel::EXPECTIMAX ? average.rounded() : worst;
+    }
+    const MoveTables& tables = getMoveTables();
+    int_fast64_t best = std::numeric_limits<int_fast64_t>::min();
+    size_t numMoves = 0;
+    if(!containsExponent(board, 11)) {
+        for(size_t m=0; m<4; ++m) {
+            uint32_t moveScore;
+            uint64_t afterstate = applyMove(tables, board, PLAYER_MOVES[m], moveScore);
+            if(afterstate != board) {
+                ++numMoves;
+                if(remainingDepth) {
+                    best = std::max(best, referenceSearch(evaluate, model, afterstate, score + moveScore, remainingDepth, true));
+                }
+            }
+        }
+    }
+    if(!remainingDepth || !numMoves) {
+        return evaluate(board, score, !numMoves);
+    }
+    return best;
+}
+
+/**
+ * Searches every position of numGames random games to depth 2 with
+ * expectimax and checks the value against referenceSearch(), and
+ * that the chosen move has that value.  Also checks the value of every
+ * move that multi-PV reports, and that it picks the same move.
+ * Returns the number of mismatches.
+ */
+size_t validateExpectimax(size_t numGames, unsigned firstSeed) {
+    const MoveTables& tables = getMoveTables();
+    HeuristicEvaluator evaluate;
+    SearchOptions options;
+    options.chanceModel = ChanceModel::EXPECTIMAX;
+    SearchOptions multiPV = options;
+    multiPV.multiPV = true;
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            uint64_t board = node.getBoard().getRawBoard();
+            bool isChance = node.getPlayer() != Player::HUMAN;
+            auto result = suggestMove(node, 2, options);
+            mismatches += result.value != referenceSearch(evaluate, ChanceModel::EXPECTIMAX, board, node.getScore(), 2, isChance);
+            if(!isChance && result.move != MoveType::GAMEOVER) {
+                uint32_t moveScore;
+                uint64_t afterstate = applyMove(tables, board, result.move, moveScore);
+                mismatches += result.value != referenceSearch(evaluate, ChanceModel::EXPECTIMAX, afterstate, node.getScore() + moveScore, 2, true);
+                auto analysis = suggestMove(node, 2, multiPV);
+                mismatches += analysis.move != result.move || analysis.value != result.value;
+                for(size_t m=0; m<4; ++m) {
+                    afterstate = applyMove(tables, board, PLAYER_MOVES[m], moveScore);
+                    bool valued = analysis.valuedMoves & (1 << m);
+                    mismatches += valued != (afterstate != board);
+                    if(valued) {
+                        mismatches += analysis.moveValues[m] != referenceSearch(evaluate, ChanceModel::EXPECTIMAX, afterstate, node.getScore() + moveScore, 2, true);
+                    }
+                }
+            }
+            if(!isChance) {
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Checks that sampled chance nodes are unbiased: for the afterstates of
+ * numGames random games with more than two empty cells, the mean
+ * depth-1 expectimax value over 1000 sampling seeds, with two cells
+ * sampled, must be within five standard errors of the full average.
+ * Returns the number of afterstates where it is not.
+ */
+size_t validateChanceSampling(size_t numGames, unsigned firstSeed) {
+    const size_t numSeeds = 1000;
+    SearchOptions full;
+    full.chanceModel = ChanceModel::EXPECTIMAX;
+    full.leafCache = false;
+    SearchOptions sampled = full;
+    sampled.sampling = ChanceSampling(0, 2, 0);
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            if(node.getPlayer() == Player::HUMAN) {
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+                continue;
+            }
+            if(node.getBoard().numEmptySpaces() > 2) {
+                long double expected = suggestMove(node, 1, full).value;
+                long double sum = 0;
+                long double sumOfSquares = 0;
+                for(size_t seed=0; seed<numSeeds; ++seed) {
+                    sampled.sampling.seed = seed;
+                    long double deviation = suggestMove(node, 1, sampled).value - expected;
+                    sum += deviation;
+                    sumOfSquares += deviation * deviation;
+                }
+                long double mean = sum / numSeeds;
+                long double standardError = sqrtl((sumOfSquares / numSeeds - mean * mean) / (numSeeds - 1));
+                mismatches += fabsl(mean) > 5 * standardError + 1;
+            }
+            node = node.getRandomSuccessorForComputer(rand);
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Proves survival for one to three moves at every position of numGames
+ * random games, and checks the answers and the proof moves against the
+ * fixed-order search.  Returns the number of mismatches.
+ */
+size_t validateSurvivalProofs(size_t numGames, unsigned firstSeed) {
+    const MoveTables& tables = getMoveTables();
+    SurvivalProver prover;
+    size_t mismatches = 0;
+    size_t position = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            if(node.getPlayer() == Player::HUMAN) {
+                uint64_t board = node.getBoard().getRawBoard();
+                size_t moves = 1 + position++ % 3;
+                auto proof = prover.prove(board, moves, std::numeric_limits<size_t>::max());
+                auto expected = prover.searchFixedOrder(board, moves, std::numeric_limits<size_t>::max());
+                mismatches += proof.result != expected.result;
+                if(proof.result == ProofResult::PROVEN) {
+                    uint32_t score;
+                    uint64_t afterstate = applyMove(tables, board, proof.move, score);
+                    if(afterstate == board) {
+                        ++mismatches;
+                    } else if(!containsExponent(afterstate, 11)) {
+                        for(uint64_t empty = emptyCellMask(afterstate); empty; empty &= empty - 1) {
+                            for(uint64_t tile : {1, 2}) {
+                                auto spawned = afterstate | (tile << __builtin_ctzll(empty));
+                                mismatches += prover.searchFixedOrder(spawned, moves - 1, std::numeric_limits<size_t>::max()).result != ProofResult::PROVEN;
+                            }
+                        }
+                    }
+                }
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Checks SmallBoardRules against sliding the lines of the board one by
+ * one, and its symmetries against the moves they swap, on numBoards
+ * random boards of every size up to 4 x 4.  Returns the number of
+ * mismatches.
+ */
+size_t validateSmallBoardMoves(size_t numBoards, unsigned seed) {
+    Xoshiro256 rand(seed);
+    size_t mismatches = 0;
+    for(size_t width=1; width<=4; ++width) {
+        for(size_t height=1; height<=4; ++height) {
+            SmallBoardRules rules(width, height);
+            for(size_t i=0; i<numBoards; ++i) {
+                uint64_t board = 0;
+                for(size_t row=0; row<height; ++row) {
+                    for(size_t col=0; col<width; ++col) {
+                        /* small exponents, for many merges */
+                        board |= (uint64_t)(rand.below(3) ? rand.below(4) + 1 : 0) << (16 * row + 4 * col);
+                    }
+                }
+                for(auto move : PLAYER_MOVES) {
+                    bool horizontal = move == MoveType::LEFT || move == MoveType::RIGHT;
+                    bool towardEnd = move == MoveType::RIGHT || move == MoveType::DOWN;
+                    size_t length = horizontal ? width : height;
+                    uint64_t expected = 0;
+                    uint32_t expectedScore = 0;
+                    for(size_t line=0; line<(horizontal ? height : width); ++line) {
+                        /* the shift of the j-th cell of the line, counted from the side the tiles slide to */
+                        auto shiftOf = [&](size_t j) {
+                            size_t k = towardEnd ? length - 1 - j : j;
+                            return horizontal ? 16 * line + 4 * k : 16 * k + 4 * line;
+                        };
+                        std::vector<uint64_t> tiles;
+                        bool merged = false;
+                        for(size_t j=0; j<length; ++j) {
+                            uint64_t tile = (board >> shiftOf(j)) & 0b1111;
+                            if(!tile) {
+                                continue;
+                            } else if(!tiles.empty() && tiles.back() == tile && !merged) {
+                                ++tiles.back();
+                                expectedScore += 1 << tiles.back();
+                                merged = true;
+                            } else {
+                                tiles.push_back(tile);
+                                merged = false;
+                            }
+                        }
+                        for(size_t j=0; j<tiles.size(); ++j) {
+                            expected |= tiles[j] << shiftOf(j);
+                        }
+                    }
+                    uint32_t score;
+                    mismatches += rules.move(board, move, score) != expected || score != expectedScore;
+                }
+                uint32_t score;
+                uint32_t imageScore;
+                mismatches += rules.move(rules.mirrored(board), MoveType::LEFT, imageScore) != rules.mirrored(rules.move(board, MoveType::RIGHT, score)) || imageScore != score;
+                mismatches += rules.move(rules.flipped(board), MoveType::UP, imageScore) != rules.flipped(rules.move(board, MoveType::DOWN, score)) || imageScore != score;
+                if(width == height) {
+                    mismatches += rules.move(transposeBoard(board), MoveType::UP, imageScore) != transposeBoard(rules.move(board, MoveType::LEFT, score)) || imageScore != score;
+                }
+                uint64_t canonical = rules.canonical(board);
+                mismatches += canonical > board || rules.canonical(rules.mirrored(board)) != canonical || rules.canonical(rules.flipped(board)) != canonical;
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Solves the 2 x 2 and 3 x 2 boards and checks every value against a
+ * plain memoized recursion over the positions, without symmetries.
+ * Returns the number of mismatches.
+ */
+size_t validateSmallBoardSolver(size_t numThreads) {
+    size_t mismatches = 0;
+    for(auto size : { std::make_pair(2, 2), std::make_pair(3, 2) }) {
+        SmallBoardSolver solver(size.first, size.second, numThreads);
+        const SmallBoardRules& rules = solver.getRules();
+        std::unordered_map<uint64_t, double> memo;
+        std::function<double(uint64_t)> valueOf = [&](uint64_t board) {
+            auto iter = memo.find(board);
+            if(iter != memo.end()) {
+                return iter->second;
+            }
+            double best = 0.0;
+            for(size_t m=0; m<4 && !containsExponent(board, 11); ++m) {
+                uint32_t score;
+                uint64_t afterstate = rules.move(board, PLAYER_MOVES[m], score);
+                if(afterstate == board) {
+                    continue;
+                }
+                uint64_t empty = rules.emptyCells(afterstate);
+                double expected = 0.0;
+                size_t numEmpty = __builtin_popcountll(empty);
+                for(; empty; empty &= empty - 1) {
+                    unsigned shift = __builtin_ctzll(empty);
+                    expected += 0.9 * valueOf(afterstate | ((uint64_t)1 << shift)) + 0.1 * valueOf(afterstate | ((uint64_t)2 << shift));
+                }
+                best = std::max(best, score + expected / numEmpty);
+            }
+            memo[board] = best;
+            return best;
+        };
+        size_t numValues = 0;
+        double start = solver.solve([&](const SmallBoardSolver::Layer& layer, const std::vector<double>& values) {
+            for(size_t i=0; i<values.size(); ++i) {
+                mismatches += std::abs(values[i] - valueOf(layer.boards[i])) > 1e-9 * std::max(1.0, values[i]);
+            }
+            numValues += values.size();
+        });
+        double expectedStart = 0.0;
+        auto starts = rules.startBoards();
+        for(auto board : starts) {
+            expectedStart += valueOf(board);
+        }
+        expectedStart /= starts.size();
+        /* every reachable position, once up to symmetry */
+        std::vector<uint64_t> canonical;
+        for(auto& entry : memo) {
+            canonical.push_back(rules.canonical(entry.first));
+        }
+        std::sort(canonical.begin(), canonical.end());
+        size_t numCanonical = std::unique(canonical.begin(), canonical.end()) - canonical.begin();
+        mismatches += numValues != numCanonical || numValues != solver.getNumStates();
+        mismatches += std::abs(start - expectedStart) > 1e-9 * std::max(1.0, start);
+    }
+    return mismatches;
+}
+
+/**
+ * Explores 8 plies from the start of a game with three threads, with
+ * and without symmetries, and checks the number of positions and edges
+ * of every ply against a serial exploration with std::unordered_set.
+ * Returns the number of mismatches.
+ */
+size_t validateStateExplorer(unsigned seed) {
+    const MoveTables& tables = getMoveTables();
+    const SmallBoardRules rules(4, 4);
+    const size_t plies = 8;
+    uint64_t start = Node(seed).getBoard().getRawBoard();
+    size_t mismatches = 0;
+    for(bool symmetric : {false, true}) {
+        auto canonical = [&](uint64_t board) { return symmetric ? rules.canonical(board) : board; };
+        std::vector<ExploredPly> expected;
+        std::unordered_set<uint64_t> frontier = { canonical(start) };
+        for(size_t ply=1; ply<=plies; ++ply) {
+            std::unordered_set<uint64_t> next;
+            ExploredPly explored = { ply, 0, 0, 0 };
+            for(auto position : frontier) {
+                std::vector<uint64_t> children;
+                if(ply % 2 == 0) {
+                    for(size_t i=0; i<16; ++i) {
+                        if(!((position >> (4 * i)) & 0b1111)) {
+                            children.push_back(position | ((uint64_t)1 << (4 * i)));
+                            children.push_back(position | ((uint64_t)2 << (4 * i)));
+                        }
+                    }
+                } else if(!containsExponent(position, 11)) {
+                    for(auto move : PLAYER_MOVES) {
+                        uint32_t score;
+                        uint64_t afterstate = applyMove(tables, position, move, score);
+                        if(afterstate != position) {
+                            children.push_back(afterstate);
+                        }
+                    }
+                }
+                explored.edges += children.size();
+                for(auto child : children) {
+                    next.insert(canonical(child));
+                }
+            }
+            explored.positions = next.size();
+            expected.push_back(explored);
+            frontier.swap(next);
+        }
+        size_t ply = 0;
+        exploreStates(start, plies, 3, symmetric, [&](const ExploredPly& explored) {
+            mismatches += explored.positions != expected[ply].positions || explored.edges != expected[ply].edges;
+            ++ply;
+        });
+        mismatches += ply != plies;
+    }
+    return mismatches;
+}
+
+/* evaluates a leaf at two scores through a CachedEvaluator and directly, and counts the differences */
+template<class Evaluator>
+size_t countLeafCacheMismatches(const Evaluator& evaluate, uint64_t board, uint32_t score, bool isGameOver) {
+    CachedEvaluator<Evaluator> cached(evaluate);
+    size_t mismatches = 0;
+    for(uint32_t s : {score, score + 1024}) {
+        mismatches += cached(board, s, isGameOver) != evaluate(board, s, isGameOver);
+    }
+    return mismatches;
+}
+
+/**
+ * Plays numGames random games and checks that every evaluator -e can
+ * select gives the same value for each position with and without the
+ * leaf cache, also when the same board comes back with another score.
+ * Returns the number of mismatches.
+ */
+size_t validateLeafCache(size_t numGames, unsigned firstSeed, const std::vector<float>& weights) {
+    RowWeightTable<float> floatTable(weights);
+    RowWeightTable<int16_t> int16Table(weights);
+    RowWeightTable<int8_t> int8Table(weights);
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        for(;;) {
+            uint64_t board = node.getBoard().getRawBoard();
+            uint32_t score = node.getScore();
+            bool isGameOver = node.isGameOver();
+            mismatches += countLeafCacheMismatches(HeuristicEvaluator(), board, score, isGameOver);
+            mismatches += countLeafCacheMismatches(OldHeuristicEvaluator(), board, score, isGameOver);
+            mismatches += countLeafCacheMismatches(RowTableEvaluator<float>(&floatTable), board, score, isGameOver);
+            mismatches += countLeafCacheMismatches(RowTableEvaluator<int16_t>(&int16Table), board, score, isGameOver);
+            mismatches += countLeafCacheMismatches(RowTableEvaluator<int8_t>(&int8Table), board, score, isGameOver);
+            if(isGameOver) {
+                break;
+            } else if(node.getPlayer() == Player::HUMAN) {
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Searches every position of numGames random games to depth 2 under
+ * minimax and expectimax, serially and with both parallel root splits,
+ * and counts the searches whose value differs from referenceSearch(),
+ * or whose move differs from the serial one with deterministic set.
+ */
+size_t validateParallelSearch(size_t numGames, unsigned firstSeed, const SearchOptions& options) {
+    size_t mismatches = 0;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            if(node.getPlayer() == Player::HUMAN) {
+                for(auto model : {ChanceModel::MINIMAX, ChanceModel::EXPECTIMAX}) {
+                    SearchOptions serial = options;
+                    serial.chanceModel = model;
+                    serial.evaluator = EvaluatorType::HEURISTIC;
+                    serial.sampling = NO_CHANCE_SAMPLING;
+                    serial.multiPV = false;
+                    serial.rootThreads = 1;
+                    /* the extension budget goes to whichever thread asks first */
+                    serial.extension = LeafExtension();
+                    SearchOptions parallel = serial;
+                    parallel.rootThreads = 3;
+                    SearchOptions deterministic = parallel;
+                    deterministic.deterministic = true;
+                    auto reference = referenceSearch(HeuristicEvaluator(), model, node.getBoard().getRawBoard(), node.getScore(), 2, false);
+                    auto serialResult = suggestMove(node, 2, serial);
+                    auto deterministicResult = suggestMove(node, 2, deterministic);
+                    /* without deterministic set, ties may go to another move */
+                    auto parallelResult = suggestMove(node, 2, parallel);
+                    mismatches += serialResult.value != reference;
+                    mismatches += deterministicResult.move != serialResult.move || deterministicResult.value != reference;
+                    mismatches += parallelResult.value != reference;
+                }
+                auto& successors = node.getSuccessors();
+                auto iter = successors.begin();
+                std::advance(iter, rand.below((uint32_t)successors.size()));
+                Node next(*iter);
+                node = std::move(next);
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Times RowWeightTable<Weight>::evaluate() on random boards and plays
+ * numGames batched games greedily with the table to measure its
+ * playing strength.
+ */
+template<class Weight>
+void benchmarkRowWeightTable(const char* name, const std::vector<float>& fullPrecision, size_t numGames, unsigned firstSeed, size_t numThreads, std::ostream& stream) {
+    RowWeightTable<Weight> table(fullPrecision);
+    Xoshiro256 rand(firstSeed);
+    /* few enough boards to stay in L1, so the timing is dominated by the table lookups */
+    std::vector<uint64_t> boards(1 << 12);
+    for(auto& board : boards) {
+        board = 0;
+        for(uint_fast8_t shift=0; shift<64; shift+=4) {
+            board |= (uint64_t)rand.below(12) << shift;
+        }
+    }
+    const size_t numEvaluations = 1 << 24;
+    int_fast64_t checksum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for(size_t i=0; i<numEvaluations; ++i) {
+        checksum += table.evaluate(boards[i & (boards.size() - 1)]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    GameStatistics stats = runBatched(numGames, firstSeed, numThreads, 4096, TableBatchPolicy<Weight>(&table));
+    stream << name << ": " << (table.footprint() / 1024) << " KiB, " << (seconds * 1e9 / numEvaluations) << " ns/evaluation (checksum " << checksum << ")" << std::endl;
+    stats.report(stream);
+    stream << std::endl;
+}
+
+void benchmarkRowWeights(const std::vector<float>& weights, size_t numGames, unsigned firstSeed, size_t numThreads, std::ostream& stream) {
+    benchmarkRowWeightTable<float>("float", weights, numGames, firstSeed, numThreads, stream);
+    benchmarkRowWeightTable<int16_t>("int16", weights, numGames, firstSeed, numThreads, stream);
+    benchmarkRowWeightTable<int8_t>("int8", weights, numGames, firstSeed, numThreads, stream);
+}
+
+/* times numDraws draws of a spawn cell (a number below 1 to 16) */
+template<class Draw>
+void benchmarkRandomDraws(const char* name, Draw draw, std::ostream& stream) {
+    const size_t numDraws = 1 << 25;
+    uint64_t checksum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for(size_t i=0; i<numDraws; ++i) {
+        checksum += draw((uint32_t)(i & 15) + 1);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    stream << name << ": " << (seconds * 1e9 / numDraws) << " ns/draw (checksum " << checksum << ")" << std::endl;
+}
+
+void benchmarkRandom(std::ostream& stream) {
+    benchmarkRandomDraws("::rand() % n", [](uint32_t bound) { return (uint32_t)::rand() % bound; }, stream);
+    std::mt19937_64 mersenne(0);
+    benchmarkRandomDraws("std::mt19937_64 with std::uniform_int_distribution", [&mersenne](uint32_t bound) {
+            return std::uniform_int_distribution<uint32_t>(0, bound - 1)(mersenne);
+        }, stream);
+    Xoshiro256 xoshiro(0);
+    benchmarkRandomDraws("Xoshiro256::below(n)", [&xoshiro](uint32_t bound) { return xoshiro.below(bound); }, stream);
+}
+
+template<class Board, class Query>
+void benchmarkBoardQuery(const char* name, const std::vector<Board>& boards, Query query, std::ostream& stream) {
+    const size_t numQueries = 1 << 24;
+    uint64_t checksum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for(size_t i=0; i<numQueries; ++i) {
+        checksum += (uint64_t)query(boards[i & (boards.size() - 1)]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    stream << name << ": " << (seconds * 1e9 / numQueries) << " ns/board (checksum " << checksum << ")" << std::endl;
+}
+/* the packed Board against the BitplaneBoard, on random boards (the checksums of a pair must agree) */
+void benchmarkBoards(unsigned firstSeed, std::ostream& stream) {
+    const MoveTables& tables = getMoveTables();
+    Xoshiro256 rand(firstSeed);
+    /* few enough boards to stay in L1 */
+    std::vector<uint64_t> raw(1 << 12);
+    for(auto& board : raw) {
+        board = 0;
+        for(uint_fast8_t shift=0; shift<64; shift+=4) {
+            /* about a third of the cells empty */
+            board |= (uint64_t)(rand.below(3) ? rand.below(11) + 1 : 0) << shift;
+        }
+    }
+    std::vector<Board> packed;
+    std::vector<BitplaneBoard> planes;
+    for(auto board : raw) {
+        packed.push_back(Board(board));
+        planes.push_back(BitplaneBoard(board));
+    }
+    benchmarkBoardQuery("Packed to bitplanes", raw, [](uint64_t board) { return BitplaneBoard(board).emptyMask(); }, stream);
+    benchmarkBoardQuery("Empty cells, Board", packed, [](const Board& board) { return board.numEmptySpaces(); }, stream);
+    benchmarkBoardQuery("Empty cells, emptyCellMask()", raw, [](uint64_t board) { return __builtin_popcountll(emptyCellMask(board)); }, stream);
+    benchmarkBoardQuery("Empty cells, BitplaneBoard", planes, [](const BitplaneBoard& board) { return board.numEmptySpaces(); }, stream);
+    benchmarkBoardQuery("Largest tile, Board", packed, [](const Board& board) { return board.getLargestExponent(); }, stream);
+    benchmarkBoardQuery("Largest tile, BitplaneBoard", planes, [](const BitplaneBoard& board) { return board.getLargestExponent(); }, stream);
+    benchmarkBoardQuery("Legal moves, row tables", raw, [&tables](uint64_t board) {
+            uint_fast8_t legal = 0;
+            for(size_t m=0; m<4; ++m) {
+                uint32_t score;
+                legal |= (applyMove(tables, board, PLAYER_MOVES[m], score) != board) << m;
+            }
+            return legal;
+        }, stream);
+    benchmarkBoardQuery("Legal moves, BitplaneBoard", planes, [](const BitplaneBoard& board) { return board.legalMoves(); }, stream);
+    benchmarkBoardQuery("Smoothness, Board", packed, [](const Board& board) { return board.getSmoothness(); }, stream);
+    benchmarkBoardQuery("Smoothness, BitplaneBoard", planes, [](const BitplaneBoard& board) { return board.getSmoothness(); }, stream);
+    benchmarkBoardQuery("Features, one pass each", packed, [](const Board& board) { return board.getFeaturesSeparately()[FeatureVector::SMOOTHNESS]; }, stream);
+    benchmarkBoardQuery("Features, fused", packed, [](const Board& board) { return board.getFeatures()[FeatureVector::SMOOTHNESS]; }, stream);
+    benchmarkBoardQuery("Heuristic, Board", packed, [](const Board& board) { return board.getHeuristic(0, false); }, stream);
+    benchmarkBoardQuery("Old heuristic, Board", packed, [](const Board& board) { return board.getHeuristicOld(0, false); }, stream);
+    benchmarkBoardQuery("Old heuristic, BitplaneBoard", planes, [](const BitplaneBoard& board) { return board.getHeuristicOld(0, false); }, stream);
+}
+
+/* up to maxPositions positions with the player to move, taken evenly from numGames games played at depth 1 */
+std::vector<Node> playedPositions(size_t numGames, unsigned firstSeed, const SearchOptions& options, size_t maxPositions) {
+    std::vector<Node> positions;
+    for(size_t game=0; game<numGames; ++game) {
+        Node node(firstSeed + (unsigned)game);
+        Xoshiro256 rand(firstSeed + (unsigned)game);
+        while(!node.isGameOver()) {
+            if(node.getPlayer() == Player::HUMAN) {
+                positions.push_back(node);
+                auto move = suggestMove(node, 1, options).move;
+                for(auto& succ : node.getSuccessors()) {
+                    if(succ.getMove() == move) {
+                        Node next(succ);
+                        node = std::move(next);
+                        break;
+                    }
+                }
+            } else {
+                node = node.getRandomSuccessorForComputer(rand);
+            }
+        }
+    }
+    if(positions.size() > maxPositions) {
+        std::vector<Node> sampled;
+        for(size_t i=0; i<maxPositions; ++i) {
+            sampled.push_back(positions[i * positions.size() / maxPositions]);
+        }
+        positions = std::move(sampled);
+    }
+    return positions;
+}
+
+/**
+ * Times suggestMoveWithDeadline() against a range of budgets, on up to
+ * 1000 positions taken evenly from numGames games played at depth 1.
+ */
+void benchmarkLatency(size_t numGames, unsigned firstSeed, const SearchOptions& options, std::ostream& stream) {
+    auto positions = playedPositions(numGames, firstSeed, options, 1000);
+    stream << "Positions: " << positions.size() << std::endl;
+    for(unsigned long budget : {50, 100, 250, 500, 1000, 5000}) {
+        std::vector<double> latencies;
+        size_t totalDepth = 0;
+        size_t fallbacks = 0;
+        for(auto& position : positions) {
+            size_t depthReached = 0;
+            auto startTime = std::chrono::steady_clock::now();
+            suggestMoveWithDeadline(position, budget, [&depthReached](size_t maxDepth, const AlphaBetaResult&) { depthReached = maxDepth; }, options);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count());
+            totalDepth += depthReached;
+            fallbacks += !depthReached;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto quantile = [&latencies](double q) { return latencies[std::min((size_t)(q * latencies.size()), latencies.size() - 1)]; };
+        stream << "Budget " << budget << " us: p50 " << quantile(0.5) << " us, p99 " << quantile(0.99) << " us, max " << latencies.back() << " us (overshoot " << latencies.back() - budget << " us), mean depth " << (double)totalDepth / positions.size() << ", static answers " << fallbacks << std::endl;
+    }
+}
+
+/**
+ * Proves whether the player can survive the given number of moves on
+ * up to 1000 positions taken evenly from numGames games played at
+ * depth 1, with the proof-number search and with the fixed-order
+ * search under the same node budget, and compares the two.
+ */
+void benchmarkSurvivalProofs(size_t numGames, unsigned firstSeed, size_t moves, size_t nodeBudget, const SearchOptions& options, std::ostream& stream) {
+    auto positions = playedPositions(numGames, firstSeed, options, 1000);
+    stream << "Positions: " << positions.size() << ", surviving " << moves << " moves, at most " << nodeBudget << " nodes each" << std::endl;
+    SurvivalProver prover;
+    std::vector<ProofResult> answers[2];
+    for(size_t method=0; method<2; ++method) {
+        size_t counts[3] = { 0, 0, 0 };
+        size_t nodes = 0;
+        double seconds = 0.0;
+        for(auto& position : positions) {
+            uint64_t board = position.getBoard().getRawBoard();
+            /* every position starts from an empty table, as the fixed-order search has none */
+            prover.clear();
+            auto startTime = std::chrono::steady_clock::now();
+            auto proof = method == 0 ? prover.prove(board, moves, nodeBudget) : prover.searchFixedOrder(board, moves, nodeBudget);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            answers[method].push_back(proof.result);
+            ++counts[(size_t)proof.result];
+            nodes += proof.nodes;
+        }
+        stream << (method == 0 ? "Proof-number search: " : "Alpha-beta search: ") << counts[0] << " proven, " << counts[1] << " disproven, " << counts[2] << " unknown, " << (double)nodes / positions.size() << " nodes and " << 1e6 * seconds / positions.size() << " us per position" << std::endl;
+    }
+    size_t disagreements = 0;
+    for(size_t i=0; i<positions.size(); ++i) {
+        disagreements += answers[0][i] != answers[1][i] && answers[0][i] != ProofResult::UNKNOWN && answers[1][i] != ProofResult::UNKNOWN;
+    }
+    stream << "Disagreements: " << disagreements << std::endl;
+}
+
+const char SMALL_BOARD_VALUES_MAGIC[8] = { '2', '0', '4', '8', 'S', 'B', 'V', '1' };
+
+/**
+ * Solves the game on a width x height board with numThreads threads
+ * and reports the size of the state space and the expected score of
+ * perfect play.  If path is given, the values are written to it: the
+ * 8-byte SMALL_BOARD_VALUES_MAGIC, the width and height as uint32s,
+ * the number of positions as a uint64, and then every canonical
+ * position as its packed board (a uint64, the board in the top-left
+ * corner) and its value (a double), from the highest tile sum down;
+ * all native-endian.  The value of any other position is that of its
+ * canonical board.
+ */
+bool solveSmallBoard(size_t width, size_t height, size_t numThreads, const char* path, std::ostream& stream) {
+    FILE* file = nullptr;
+    if(path && !(file = fopen(path, "wb"))) {
+        std::cerr << "Error opening " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    SmallBoardSolver solver(width, height, numThreads);
+    bool ok = true;
+    size_t numLayers = 0;
+    size_t largestLayer = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    double enumerated = 0.0;
+    double start = solver.solve([&](const SmallBoardSolver::Layer& layer, const std::vector<double>& values) {
+        if(!numLayers++) {
+            enumerated = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            if(file) {
+                uint32_t size[2] = { (uint32_t)width, (uint32_t)height };
+                uint64_t numStates = solver.getNumStates();
+                ok = fwrite(SMALL_BOARD_VALUES_MAGIC, 1, sizeof(SMALL_BOARD_VALUES_MAGIC), file) == sizeof(SMALL_BOARD_VALUES_MAGIC)
+                    && fwrite(size, sizeof(uint32_t), 2, file) == 2
+                    && fwrite(&numStates, sizeof(numStates), 1, file) == 1;
+            }
+        }
+        largestLayer = std::max(largestLayer, values.size());
+        for(size_t i=0; i<values.size() && file && ok; ++i) {
+            ok = fwrite(&layer.boards[i], sizeof(uint64_t), 1, file) == 1 && fwrite(&values[i], sizeof(double), 1, file) == 1;
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    if(file) {
+        ok = fclose(file) == 0 && ok;
+        if(!ok) {
+            std::cerr << "Error writing " << path << std::endl;
+        }
+    }
+    stream << "Board: " << width << "x" << height << std::endl;
+    stream << "Positions: " << solver.getNumStates() << " (largest tile sum layer " << largestLayer << ")" << std::endl;
+    stream << "Memory: " << solver.getNumStates() * sizeof(uint64_t) / 1048576.0 << " MiB of boards, " << 3 * largestLayer * sizeof(double) / 1048576.0 << " MiB of values at most" << std::endl;
+    stream << "Time: " << enumerated << " s to enumerate, " << seconds - enumerated << " s to solve" << std::endl;
+    stream << "Expected score with perfect play: " << std::setprecision(10) << start << std::endl;
+    return ok;
+}
+
+/**
+ * Explores up to plies plies from the start of the game with the seed
+ * and reports, for every ply, the distinct positions, the edges into
+ * them, the branching factor and the memory the ply took.
+ */
+void reportStateSpace(unsigned seed, size_t plies, size_t numThreads, bool symmetric, std::ostream& stream) {
+    uint64_t start = Node(seed).getBoard().getRawBoard();
+    stream << "Start: 0x" << std::hex << std::setw(16) << std::setfill('0') << start << std::dec << std::setfill(' ') << (symmetric ? ", up to symmetry" : "") << std::endl;
+    uint64_t previous = 1;
+    uint64_t total = 1;
+    size_t peakBytes = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    exploreStates(start, plies, numThreads, symmetric, [&](const ExploredPly& explored) {
+        stream << "Ply " << explored.ply << (explored.ply % 2 ? " (moves): " : " (spawns): ") << explored.positions << " positions, " << explored.edges << " edges, branching " << (double)explored.edges / previous << ", " << (explored.edges ? 100.0 * (explored.edges - explored.positions) / explored.edges : 0.0) << "% transpositions, " << explored.bytes / 1048576.0 << " MiB" << std::endl;
+        previous = explored.positions;
+        total += explored.positions;
+        peakBytes = std::max(peakBytes, explored.bytes);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    stream << "Total: " << total << " positions in " << seconds << " s, at most " << peakBytes / 1048576.0 << " MiB" << std::endl;
+}
+
+#if USE_CURSES
+MoveType printState(const Node& node, unsigned long aiTimeoutInUs, const SearchOptions& options) {
+    clear();
+    std::stringstream ss;
+    ss << node;
+    int height, width;
+    getmaxyx(stdscr,height,width);
+    std::string fileLine;
+    std::list<std::string> lines;
+    while(std::getline(ss, fileLine)) {
+        /* remove the newline */
+        lines.push_back(fileLine);//.substr(0, fileLine.size()-1));
+    }
+    bool gameOver = node.isGameOver();
+    if(gameOver) {
+        mvprintw((height - lines.size())/2 - 3,(width - 10)/2,"Game Over!");
+        mvprintw((height - lines.size())/2 - 2,(width - 18)/2,"Final Score: %d",node.getScore());
+        mvprintw(height - 2,(width - 21)/2,"Press Any Key to Quit");
+    } else {
+        mvprintw((height - lines.size())/2 - 2,(width - 12)/2,"Score: %d",node.getScore());
+    }
+    int i = 0;
+    for(auto& line : lines) {
+        mvprintw((height - lines.size())/2 + i++,(width-line.length())/2,"%s",line.c_str());
+    }
+
+    if(gameOver) {
+        return Move::START;
     }
 
     //auto suggestion = suggestMove(node, 5);
-    auto suggestion = suggestMoveWithDeadline(node, aiTimeout, [height, width, &lines](size_t maxDepth, const AlphaBetaResult& result) {
+    auto suggestion = suggestMoveWithDeadline(node, aiTimeoutInUs, [height, width, &lines](size_t maxDepth, const AlphaBetaResult& result) {
             if(result.value >= 0) {
                 std::string suggestion = "Suggested Move: ";
                 switch(result.move) {
@@ -899,11 +5394,23 @@ MoveType printState(const Node& node, unsigned long aiTimeout) {
                 mvprintw((height - lines.size())/2 + 2 + lines.size(),(width-14)/2,"No Suggestion!");
             }
 
-            mvprintw((height - lines.size())/2 + 4 + lines.size(),(width-19)/2, "Searching to Ply: %lu", (unsigned long)((maxDepth - 1) * 2));
+            /* each unit of depth is a move and a spawn; depth 0 is suggestStaticMove() */
+            if(maxDepth == 0) {
+                mvprintw((height - lines.size())/2 + 4 + lines.size(),(width-24)/2, "Searching to Ply: static");
+            } else {
+                mvprintw((height - lines.size())/2 + 4 + lines.size(),(width-19)/2, "Searching to Ply: %lu", (unsigned long)(maxDepth * 2));
+            }
             mvprintw((height - lines.size())/2 + 5 + lines.size(),(width-15)/2, "Pruned Nodes: %lu", (unsigned long)(result.prunedNodes));
+            if(result.valuedMoves) {
+                std::stringstream values;
+                printMoveValues(values, result);
+                move(height - 4, 0);
+                clrtoeol();
+                mvprintw(height - 4,(width-values.str().length())/2,"%s",values.str().c_str());
+            }
 
             refresh();
-        });
+        }, options);
 
     return suggestion.move;
 }
@@ -914,30 +5421,457 @@ int main(int argc, char** argv) {
 
     bool runAutomated = false;
     bool printUsage = false;
-    unsigned long aiTimeout = 300;
+    unsigned long aiTimeoutInUs = 300000;
+    size_t numGames = 0;
+    size_t numThreads = 1;
+    size_t searchDepth = 0;
+    unsigned firstSeed = 0;
+    const char* batchPolicy = nullptr;
+    size_t batchWidth = 4096;
+    bool validate = false;
+    const char* trainingPrefix = nullptr;
+    size_t numShards = 1;
+    const char* weightsPath = nullptr;
+    const char* writeWeightsPath = nullptr;
+    int quantizeBits = 32;
+    bool benchWeights = false;
+    bool benchRandom = false;
+    bool benchLatency = false;
+    bool benchBoards = false;
+    const char* tablesPath = nullptr;
+    const char* writeTablesPath = nullptr;
+    const char* exportFeaturesPath = nullptr;
+    size_t survivalMoves = 0;
+    const char* smallBoardSize = nullptr;
+    size_t explorePlies = 0;
+    bool exploreSymmetric = false;
+    const char* valuesPath = nullptr;
+    size_t proofBudget = 1000000;
+    const char* checkpointPath = nullptr;
+    double checkpointInterval = 60.0;
+    bool resume = false;
+    const char* workerPlacementName = "none";
+    const char* tablePlacementName = "shared";
+    SearchOptions search;
+    const char* evaluatorName = "heuristic";
     
     bool nextIsTimeout = false;
+    bool nextIsNumGames = false;
+    bool nextIsNumThreads = false;
+    bool nextIsDepth = false;
+    bool nextIsSeed = false;
+    bool nextIsBatchPolicy = false;
+    bool nextIsBatchWidth = false;
+    bool nextIsTrainingPrefix = false;
+    bool nextIsNumShards = false;
+    bool nextIsWeightsPath = false;
+    bool nextIsWriteWeightsPath = false;
+    bool nextIsQuantizeBits = false;
+    bool nextIsTablesPath = false;
+    bool nextIsWriteTablesPath = false;
+    bool nextIsExportFeaturesPath = false;
+    bool nextIsSurvivalMoves = false;
+    bool nextIsSmallBoardSize = false;
+    bool nextIsExplorePlies = false;
+    bool nextIsValuesPath = false;
+    bool nextIsProofBudget = false;
+    bool nextIsSamplingDepth = false;
+    bool nextIsNumSamples = false;
+    bool nextIsSamplingSeed = false;
+    bool nextIsEvaluator = false;
+    bool nextIsRootThreads = false;
+    bool nextIsExtensionPlies = false;
+    bool nextIsExtensionBudget = false;
+    bool nextIsCheckpointPath = false;
+    bool nextIsCheckpointInterval = false;
+    bool nextIsWorkerPlacement = false;
+    bool nextIsTablePlacement = false;
 
     for(int i=1; i<argc; ++i) {
         if(nextIsTimeout) {
-            aiTimeout = (unsigned long)atol(argv[i]);
+            aiTimeoutInUs = (unsigned long)(std::max(atof(argv[i]), 0.0) * 1000 + 0.5);
             nextIsTimeout = false;
+        } else if(nextIsNumGames) {
+            numGames = (size_t)atol(argv[i]);
+            nextIsNumGames = false;
+        } else if(nextIsNumThreads) {
+            numThreads = (size_t)atol(argv[i]);
+            nextIsNumThreads = false;
+        } else if(nextIsDepth) {
+            searchDepth = (size_t)atol(argv[i]);
+            nextIsDepth = false;
+        } else if(nextIsSeed) {
+            firstSeed = (unsigned)atol(argv[i]);
+            nextIsSeed = false;
+        } else if(nextIsBatchPolicy) {
+            batchPolicy = argv[i];
+            nextIsBatchPolicy = false;
+        } else if(nextIsBatchWidth) {
+            batchWidth = std::max((size_t)atol(argv[i]), (size_t)1);
+            nextIsBatchWidth = false;
+        } else if(nextIsTrainingPrefix) {
+            trainingPrefix = argv[i];
+            nextIsTrainingPrefix = false;
+        } else if(nextIsNumShards) {
+            numShards = (size_t)atol(argv[i]);
+            nextIsNumShards = false;
+        } else if(nextIsWeightsPath) {
+            weightsPath = argv[i];
+            nextIsWeightsPath = false;
+        } else if(nextIsWriteWeightsPath) {
+            writeWeightsPath = argv[i];
+            nextIsWriteWeightsPath = false;
+        } else if(nextIsQuantizeBits) {
+            quantizeBits = atoi(argv[i]);
+            nextIsQuantizeBits = false;
+        } else if(nextIsTablesPath) {
+            tablesPath = argv[i];
+            nextIsTablesPath = false;
+        } else if(nextIsWriteTablesPath) {
+            writeTablesPath = argv[i];
+            nextIsWriteTablesPath = false;
+        } else if(nextIsExportFeaturesPath) {
+            exportFeaturesPath = argv[i];
+            nextIsExportFeaturesPath = false;
+        } else if(nextIsSurvivalMoves) {
+            survivalMoves = std::max((size_t)atol(argv[i]), (size_t)1);
+            nextIsSurvivalMoves = false;
+        } else if(nextIsSmallBoardSize) {
+            smallBoardSize = argv[i];
+            nextIsSmallBoardSize = false;
+        } else if(nextIsExplorePlies) {
+            explorePlies = std::max((size_t)atol(argv[i]), (size_t)1);
+            nextIsExplorePlies = false;
+        } else if(nextIsValuesPath) {
+            valuesPath = argv[i];
+            nextIsValuesPath = false;
+        } else if(nextIsProofBudget) {
+            proofBudget = std::max((size_t)atol(argv[i]), (size_t)1);
+            nextIsProofBudget = false;
+        } else if(nextIsSamplingDepth) {
+            search.sampling.depth = (size_t)atol(argv[i]);
+            nextIsSamplingDepth = false;
+        } else if(nextIsNumSamples) {
+            search.sampling.numSamples = (size_t)atol(argv[i]);
+            nextIsNumSamples = false;
+        } else if(nextIsSamplingSeed) {
+            search.sampling.seed = (uint64_t)strtoull(argv[i], nullptr, 10);
+            nextIsSamplingSeed = false;
+        } else if(nextIsEvaluator) {
+            evaluatorName = argv[i];
+            nextIsEvaluator = false;
+        } else if(nextIsCheckpointPath) {
+            checkpointPath = argv[i];
+            nextIsCheckpointPath = false;
+        } else if(nextIsCheckpointInterval) {
+            checkpointInterval = std::max(atof(argv[i]), 0.1);
+            nextIsCheckpointInterval = false;
+        } else if(nextIsWorkerPlacement) {
+            workerPlacementName = argv[i];
+            nextIsWorkerPlacement = false;
+        } else if(nextIsTablePlacement) {
+            tablePlacementName = argv[i];
+            nextIsTablePlacement = false;
+        } else if(nextIsRootThreads) {
+            search.rootThreads = std::max((size_t)atol(argv[i]), (size_t)1);
+            nextIsRootThreads = false;
+        } else if(nextIsExtensionPlies) {
+            search.extension.plies = (size_t)atol(argv[i]);
+            nextIsExtensionPlies = false;
+        } else if(nextIsExtensionBudget) {
+            search.extension.budget = (size_t)atol(argv[i]);
+            nextIsExtensionBudget = false;
         } else {
             runAutomated = runAutomated || !strcmp(argv[i], "-a");
             nextIsTimeout = !strcmp(argv[i], "-t");
+            nextIsNumGames = !strcmp(argv[i], "-n");
+            nextIsNumThreads = !strcmp(argv[i], "-j");
+            nextIsDepth = !strcmp(argv[i], "-d");
+            nextIsSeed = !strcmp(argv[i], "-s");
+            nextIsBatchPolicy = !strcmp(argv[i], "-b");
+            nextIsBatchWidth = !strcmp(argv[i], "-w");
+            nextIsTrainingPrefix = !strcmp(argv[i], "-o");
+            nextIsNumShards = !strcmp(argv[i], "--shards");
+            nextIsWeightsPath = !strcmp(argv[i], "--weights");
+            nextIsWriteWeightsPath = !strcmp(argv[i], "--write-weights");
+            nextIsQuantizeBits = !strcmp(argv[i], "--quantize");
+            nextIsTablesPath = !strcmp(argv[i], "--tables");
+            nextIsWriteTablesPath = !strcmp(argv[i], "--write-tables");
+            nextIsExportFeaturesPath = !strcmp(argv[i], "--export-features");
+            nextIsSurvivalMoves = !strcmp(argv[i], "--prove-survival");
+            nextIsProofBudget = !strcmp(argv[i], "--prove-budget");
+            nextIsSmallBoardSize = !strcmp(argv[i], "--solve-small");
+            nextIsValuesPath = !strcmp(argv[i], "--write-values");
+            nextIsExplorePlies = !strcmp(argv[i], "--explore");
+            exploreSymmetric = exploreSymmetric || !strcmp(argv[i], "--symmetric");
+            nextIsSamplingDepth = !strcmp(argv[i], "--sample-depth");
+            nextIsNumSamples = !strcmp(argv[i], "--samples");
+            nextIsSamplingSeed = !strcmp(argv[i], "--sample-seed");
+            nextIsEvaluator = !strcmp(argv[i], "-e");
+            nextIsRootThreads = !strcmp(argv[i], "--root-threads");
+            nextIsExtensionPlies = !strcmp(argv[i], "--extend");
+            nextIsExtensionBudget = !strcmp(argv[i], "--extend-budget");
+            nextIsCheckpointPath = !strcmp(argv[i], "--checkpoint");
+            nextIsCheckpointInterval = !strcmp(argv[i], "--checkpoint-every");
+            resume = resume || !strcmp(argv[i], "--resume");
+            nextIsWorkerPlacement = !strcmp(argv[i], "--pin");
+            nextIsTablePlacement = !strcmp(argv[i], "--numa-tables");
+            if(!strcmp(argv[i], "--expectimax")) {
+                search.chanceModel = ChanceModel::EXPECTIMAX;
+            }
+            search.multiPV = search.multiPV || !strcmp(argv[i], "--multipv");
+            search.deterministic = search.deterministic || !strcmp(argv[i], "--deterministic");
+            search.leafCache = search.leafCache && strcmp(argv[i], "--no-leaf-cache");
+            benchWeights = benchWeights || !strcmp(argv[i], "--bench-weights");
+            benchRandom = benchRandom || !strcmp(argv[i], "--bench-random");
+            benchLatency = benchLatency || !strcmp(argv[i], "--bench-latency");
+            benchBoards = benchBoards || !strcmp(argv[i], "--bench-board");
+            validate = validate || !strcmp(argv[i], "--validate");
             printUsage = printUsage || !strcmp(argv[i], "-h") || !strcmp(argv[i], "--help") || !strcmp(argv[i], "-?");
         }
     }
 
     if(printUsage) {
-        std::cerr << "Usage: 2048 [-a] [-t TIMEOUT_MILLISECONDS] [-h | --help]" << std::endl << std::endl;
+        std::cerr << "Usage: 2048 [-a] [-t TIMEOUT_MILLISECONDS] [-e EVALUATOR] [--expectimax] [--multipv] [--root-threads THREADS] [--deterministic] [--no-leaf-cache] [--extend PLIES [--extend-budget NODES]] [--sample-depth DEPTH [--samples K] [--sample-seed SEED]] [-n GAMES [-j THREADS] [-d DEPTH] [-s SEED] [-b POLICY [-w WIDTH]] [-o PREFIX [--shards SHARDS]] [--checkpoint FILE [--checkpoint-every SECONDS] [--resume]] [--pin PLACEMENT] [--numa-tables TABLES]] [--weights FILE [--quantize BITS]] [--write-weights FILE] [--tables FILE] [--write-tables FILE] [--export-features SHARD] [--prove-survival MOVES [--prove-budget NODES]] [--solve-small WIDTHxHEIGHT [-j THREADS] [--write-values FILE]] [--explore PLIES [-s SEED] [-j THREADS] [--symmetric]] [--bench-weights] [--bench-random] [--bench-latency] [--bench-board] [--validate] [-h | --help]" << std::endl << std::endl;
         std::cerr << "\t-a\tRun automated, with the AI playing as the human" << std::endl;
-        std::cerr << "\t-t\tTimeout for the AI player in milliseconds" << std::endl;
+        std::cerr << "\t-t\tTimeout for the AI player in milliseconds, to the microsecond (e.g. 0.5)" << std::endl;
+        std::cerr << "\t-e\tEvaluate leaves with heuristic (the default), old (the old heuristic) or table (the row weights)" << std::endl;
+        std::cerr << "\t--expectimax\tTreat spawns as random (expectimax) instead of adversarial (minimax)" << std::endl;
+        std::cerr << "\t--multipv\tSearch every root move in parallel and report all of their values (in headless games, one analysis line per completed depth)" << std::endl;
+        std::cerr << "\t--root-threads\tSplit the root moves of each search over THREADS threads (default 1)" << std::endl;
+        std::cerr << "\t--deterministic\tMake the parallel search and the headless and batched worker threads give the same results on every run" << std::endl;
+        std::cerr << "\t--no-leaf-cache\tEvaluate every leaf instead of looking it up in a per-thread cache first" << std::endl;
+        std::cerr << "\t--extend\tSearch unstable leaves (nearly full, largest tile out of its corner, or a large merge pending) up to PLIES plies deeper" << std::endl;
+        std::cerr << "\t--extend-budget\tExtend at most NODES nodes per search (default 20000)" << std::endl;
+        std::cerr << "\t--sample-depth\tFrom this search DEPTH on, only search the spawns in K sampled empty cells at each chance node" << std::endl;
+        std::cerr << "\t--samples\tNumber of empty cells K to sample per chance node, each with a 2 and a 4 (default 2)" << std::endl;
+        std::cerr << "\t--sample-seed\tSeed that the spawn sampling is a deterministic function of (default 0)" << std::endl;
+        std::cerr << "\t-n\tPlay GAMES games headless (without the curses interface) and print aggregate statistics" << std::endl;
+        std::cerr << "\t-j\tNumber of worker threads for headless games (default 1)" << std::endl;
+        std::cerr << "\t-d\tSearch to a fixed DEPTH in headless games instead of using the timeout" << std::endl;
+        std::cerr << "\t-s\tSeed of the first headless game; game i uses SEED + i (default 0)" << std::endl;
+        std::cerr << "\t-b\tPlay the headless games with the batched simulator and a cheap POLICY (random, greedy or table) instead of the search" << std::endl;
+        std::cerr << "\t-w\tNumber of games each thread of the batched simulator advances in lockstep (default 4096)" << std::endl;
+        std::cerr << "\t-o\tAppend (afterstate, outcome) training samples of the headless games to PREFIX.NNN.bin" << std::endl;
+        std::cerr << "\t--shards\tNumber of training data files to spread the games over (default 1)" << std::endl;
+        std::cerr << "\t--checkpoint\tPeriodically save the progress of the headless games to FILE" << std::endl;
+        std::cerr << "\t--checkpoint-every\tSeconds between checkpoints (default 60)" << std::endl;
+        std::cerr << "\t--resume\tContinue the headless games from the checkpoint FILE, if it exists" << std::endl;
+        std::cerr << "\t--pin\tPin the headless and batched worker threads to CPUs: compact (fill one NUMA node first) or spread (over the nodes in turn)" << std::endl;
+        std::cerr << "\t--numa-tables\tKeep the tables the workers read shared (the default), replicate them on every NUMA node, or interleave them over the nodes" << std::endl;
+        std::cerr << "\t--weights\tLoad the row weight table for \"-b table\" and \"-e table\" from a full-precision FILE (default: built-in heuristic)" << std::endl;
+        std::cerr << "\t--quantize\tStore the row weights as 16 or 8 bit integers instead of 32 bit floats (the default)" << std::endl;
+        std::cerr << "\t--write-weights\tWrite the full-precision row weights to FILE" << std::endl;
+        std::cerr << "\t--tables\tMap the move and row weight tables read-only from a shared FILE, generating it first if it does not exist" << std::endl;
+        std::cerr << "\t--write-tables\tGenerate the shared tables FILE (from --weights, if given) and exit" << std::endl;
+        std::cerr << "\t--export-features\tWrite the samples of a training data SHARD as CSV, with the features of each afterstate, and exit" << std::endl;
+        std::cerr << "\t--prove-survival\tProve whether the player can survive MOVES moves against the worst spawns, on positions from GAMES (default 10) games, with proof-number and alpha-beta search" << std::endl;
+        std::cerr << "\t--prove-budget\tGive up on a position after NODES nodes (default 1000000)" << std::endl;
+        std::cerr << "\t--solve-small\tSolve the game exactly on a small board, e.g. 3x3, and report the expected score of perfect play" << std::endl;
+        std::cerr << "\t--write-values\tWrite the exact value of every reachable position of the small board to FILE" << std::endl;
+        std::cerr << "\t--explore\tCount the distinct positions reachable in each of PLIES plies (moves and spawns) from the start of game SEED" << std::endl;
+        std::cerr << "\t--symmetric\tCount positions that are mirror images or rotations of each other once" << std::endl;
+        std::cerr << "\t--bench-weights\tCompare the speed and playing strength (over GAMES games, default 1000) of float, int16 and int8 row weights" << std::endl;
+        std::cerr << "\t--bench-random\tCompare the speed of ::rand(), std::mt19937_64 and the Xoshiro256 streams" << std::endl;
+        std::cerr << "\t--bench-board\tCompare the packed board and the bitplane board on empty cells, legal moves and the heuristics" << std::endl;
+        std::cerr << "\t--bench-latency\tMeasure how long moves take with budgets from 50 us to 5 ms, on positions from GAMES (default 10) games" << std::endl;
+        std::cerr << "\t--validate\tCheck the batched simulator's move tables against Board::move on GAMES (default 100) random games, and the deterministic parallel search against the serial one on the first 10 of them" << std::endl;
         std::cerr << "\t-h\tPrint this help message" << std::endl;
         std::cerr << std::endl;
         return 0;
     }
 
+    std::vector<float> rowWeights;
+    if(weightsPath && !loadRowWeights(weightsPath, rowWeights)) {
+        return 1;
+    }
+    /* the default weights are only computed if something needs them */
+    auto fullPrecisionWeights = [&rowWeights]() -> std::vector<float>& {
+        if(rowWeights.empty()) {
+            rowWeights = defaultRowWeights();
+        }
+        return rowWeights;
+    };
+
+    std::unique_ptr<SharedTables> sharedTables;
+    if(tablesPath) {
+        sharedTables.reset(new SharedTables());
+        if(!sharedTables->open(tablesPath, fullPrecisionWeights)) {
+            return 1;
+        }
+        mappedMoveTables = &sharedTables->getMoveTables();
+    }
+
+    if(trainingPrefix && batchPolicy) {
+        std::cerr << "The batched simulator does not search, so it cannot write training samples: -o cannot be combined with -b" << std::endl;
+        return 1;
+    }
+
+    if(search.extension.plies && search.deterministic && (search.rootThreads > 1 || search.multiPV)) {
+        std::cerr << "--extend shares its budget between the root threads, so it cannot be combined with --deterministic parallel searches" << std::endl;
+        return 1;
+    }
+
+    if(!strcmp(evaluatorName, "old")) {
+        search.evaluator = EvaluatorType::HEURISTIC_OLD;
+    } else if(!strcmp(evaluatorName, "table")) {
+        search.evaluator = EvaluatorType::ROW_TABLE;
+    } else if(strcmp(evaluatorName, "heuristic")) {
+        std::cerr << "Unknown evaluator: " << evaluatorName << std::endl;
+        return 1;
+    }
+    if(quantizeBits != 32 && quantizeBits != 16 && quantizeBits != 8) {
+        std::cerr << "Unsupported quantization: " << quantizeBits << " bits (8, 16 or 32)" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<RowWeightTable<float>> floatTable;
+    std::unique_ptr<RowWeightTable<int16_t>> int16Table;
+    std::unique_ptr<RowWeightTable<int8_t>> int8Table;
+    if(search.evaluator == EvaluatorType::ROW_TABLE || (batchPolicy && !strcmp(batchPolicy, "table"))) {
+        if(sharedTables && !sharedTables->hasRowWeights(fullPrecisionWeights())) {
+            std::cerr << tablesPath << " was generated from other row weights; remove it or regenerate it with --write-tables" << std::endl;
+            return 1;
+        }
+        if(quantizeBits == 8) {
+            int8Table.reset(new RowWeightTable<int8_t>(sharedTables ? sharedTables->getInt8Weights() : RowWeightTable<int8_t>(fullPrecisionWeights())));
+        } else if(quantizeBits == 16) {
+            int16Table.reset(new RowWeightTable<int16_t>(sharedTables ? sharedTables->getInt16Weights() : RowWeightTable<int16_t>(fullPrecisionWeights())));
+        } else {
+            floatTable.reset(new RowWeightTable<float>(sharedTables ? sharedTables->getFloatWeights() : RowWeightTable<float>(fullPrecisionWeights())));
+        }
+        search.floatTable = floatTable.get();
+        search.int16Table = int16Table.get();
+        search.int8Table = int8Table.get();
+    }
+
+    WorkerPlacement workerPlacement = WorkerPlacement::NONE;
+    if(!strcmp(workerPlacementName, "compact")) {
+        workerPlacement = WorkerPlacement::COMPACT;
+    } else if(!strcmp(workerPlacementName, "spread")) {
+        workerPlacement = WorkerPlacement::SPREAD;
+    } else if(strcmp(workerPlacementName, "none")) {
+        std::cerr << "Unknown worker placement: " << workerPlacementName << std::endl;
+        return 1;
+    }
+    TablePlacement tablePlacement = TablePlacement::SHARED;
+    if(!strcmp(tablePlacementName, "replicate")) {
+        tablePlacement = TablePlacement::REPLICATED;
+    } else if(!strcmp(tablePlacementName, "interleave")) {
+        tablePlacement = TablePlacement::INTERLEAVED;
+    } else if(strcmp(tablePlacementName, "shared")) {
+        std::cerr << "Unknown table placement: " << tablePlacementName << std::endl;
+        return 1;
+    }
+    std::unique_ptr<NumaPlacement> placement;
+    if(workerPlacement != WorkerPlacement::NONE || tablePlacement != TablePlacement::SHARED) {
+        placement.reset(new NumaPlacement(workerPlacement, tablePlacement, search));
+        numaPlacement = placement.get();
+    }
+
+    /* every search that runs at once gets its helper threads up front */
+    if((search.rootThreads > 1 || search.multiPV) && !batchPolicy && !writeWeightsPath && !writeTablesPath && !exportFeaturesPath && !benchRandom && !benchWeights && !benchBoards) {
+        workerPool().reserve((numGames ? numThreads : 1) * ((search.multiPV ? 4 : search.rootThreads) - 1));
+    }
+
+    if(writeWeightsPath) {
+        return saveRowWeights(writeWeightsPath, fullPrecisionWeights()) ? 0 : 1;
+    } else if(writeTablesPath) {
+        return SharedTables::write(writeTablesPath, fullPrecisionWeights()) ? 0 : 1;
+    } else if(exportFeaturesPath) {
+        return exportFeatures(exportFeaturesPath, std::cout) ? 0 : 1;
+    } else if(benchRandom) {
+        benchmarkRandom(std::cout);
+        return 0;
+    } else if(benchBoards) {
+        benchmarkBoards(firstSeed, std::cout);
+        return 0;
+    } else if(explorePlies) {
+        reportStateSpace(firstSeed, explorePlies, numThreads, exploreSymmetric, std::cout);
+        return 0;
+    } else if(smallBoardSize) {
+        size_t width = 0;
+        size_t height = 0;
+        char end;
+        if(sscanf(smallBoardSize, "%zux%zu%c", &width, &height, &end) != 2 || width < 1 || width > 4 || height < 1 || height > 4) {
+            std::cerr << "The board size must be WIDTHxHEIGHT, each from 1 to 4: " << smallBoardSize << std::endl;
+            return 1;
+        }
+        return solveSmallBoard(width, height, numThreads, valuesPath, std::cout) ? 0 : 1;
+    } else if(survivalMoves) {
+        benchmarkSurvivalProofs(numGames ? numGames : 10, firstSeed, survivalMoves, proofBudget, search, std::cout);
+        return 0;
+    } else if(benchLatency) {
+        benchmarkLatency(numGames ? numGames : 10, firstSeed, search, std::cout);
+        return 0;
+    } else if(benchWeights) {
+        benchmarkRowWeights(fullPrecisionWeights(), numGames ? numGames : 1000, firstSeed, numThreads, std::cout);
+        return 0;
+    } else if(validate) {
+        size_t mismatches = validateMoveTables(numGames ? numGames : 100, firstSeed);
+        mismatches += validateBoardQueries(numGames ? numGames : 100, firstSeed);
+        mismatches += validateSurvivalProofs(std::min(numGames ? numGames : 100, (size_t)10), firstSeed);
+        mismatches += validateSmallBoardMoves(numGames ? 10 * numGames : 1000, firstSeed);
+        mismatches += validateSmallBoardSolver(numThreads);
+        mismatches += validateStateExplorer(firstSeed);
+        mismatches += validateChanceAverages(numGames ? 1000 * numGames : 100000, firstSeed);
+        mismatches += validateExpectimax(std::min(numGames ? numGames : 100, (size_t)10), firstSeed);
+        mismatches += validateChanceSampling(std::min(numGames ? numGames : 100, (size_t)2), firstSeed);
+        mismatches += validateLeafCache(numGames ? numGames : 100, firstSeed, fullPrecisionWeights());
+        mismatches += validateParallelSearch(std::min(numGames ? numGames : 100, (size_t)10), firstSeed, search);
+        std::cout << "Mismatches: " << mismatches << std::endl;
+        return mismatches ? 1 : 0;
+    } else if(numGames > 0 && batchPolicy) {
+        SignalWatcher::block();
+        SignalWatcher signals;
+        signalWatcher = &signals;
+        GameStatistics stats;
+        if(!strcmp(batchPolicy, "random")) {
+            stats = runBatched(numGames, firstSeed, numThreads, batchWidth, RandomBatchPolicy(), search.deterministic);
+        } else if(!strcmp(batchPolicy, "greedy")) {
+            stats = runBatched(numGames, firstSeed, numThreads, batchWidth, GreedyBatchPolicy(), search.deterministic);
+        } else if(!strcmp(batchPolicy, "table") && int8Table) {
+            stats = runBatched(numGames, firstSeed, numThreads, batchWidth, TableBatchPolicy<int8_t>(int8Table.get()), search.deterministic);
+        } else if(!strcmp(batchPolicy, "table") && int16Table) {
+            stats = runBatched(numGames, firstSeed, numThreads, batchWidth, TableBatchPolicy<int16_t>(int16Table.get()), search.deterministic);
+        } else if(!strcmp(batchPolicy, "table")) {
+            stats = runBatched(numGames, firstSeed, numThreads, batchWidth, TableBatchPolicy<float>(floatTable.get()), search.deterministic);
+        } else {
+            std::cerr << "Unknown batch policy: " << batchPolicy << std::endl;
+            return 1;
+        }
+        stats.report(std::cout);
+        return 0;
+    } else if(numGames > 0) {
+        SignalWatcher::block();
+        SignalWatcher signals;
+        signalWatcher = &signals;
+        std::unique_ptr<TrainingDataWriter> trainingData;
+        if(trainingPrefix) {
+            trainingData.reset(new TrainingDataWriter(trainingPrefix, numShards));
+            if(!trainingData->good()) {
+                return 1;
+            }
+        }
+        std::unique_ptr<HeadlessCheckpoint> resumeFrom;
+        if(resume && !checkpointPath) {
+            std::cerr << "--resume needs a --checkpoint FILE" << std::endl;
+            return 1;
+        } else if(resume && !access(checkpointPath, F_OK)) {
+            resumeFrom.reset(new HeadlessCheckpoint());
+            if(!resumeFrom->load(checkpointPath)) {
+                return 1;
+            } else if(resumeFrom->numGames != numGames || resumeFrom->firstSeed != firstSeed) {
+                std::cerr << checkpointPath << " is a checkpoint of " << resumeFrom->numGames << " games from seed " << resumeFrom->firstSeed << std::endl;
+                return 1;
+            } else if(trainingData && !trainingData->truncate(resumeFrom->shardSizes)) {
+                return 1;
+            }
+        }
+        runHeadless(numGames, firstSeed, numThreads, searchDepth, aiTimeoutInUs, search, trainingData.get(), resumeFrom.get(), checkpointPath, checkpointInterval).report(std::cout);
+        return trainingData && !trainingData->close() ? 1 : 0;
+    }
+
 #if USE_CURSES
     initscr();
     if(runAutomated) {
@@ -960,7 +5894,7 @@ int main(int argc, char** argv) {
         if(node.getPlayer() == Player::HUMAN) {
             MoveType move = Move::START;
 #if USE_CURSES
-            MoveType suggestedMove = printState(node, aiTimeout);
+            MoveType suggestedMove = printState(node, aiTimeoutInUs, search);
             int c = getch();
 #else
             std::cout << node << std::endl;
@@ -1041,7 +5975,7 @@ int main(int argc, char** argv) {
 
     if(runAutomated) {
 #if USE_CURSES
-        printState(node, aiTimeout);
+        printState(node, aiTimeoutInUs, search);
         node.clearSuccessorCache();
         timeout(-1);
         getch();